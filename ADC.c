@@ -27,6 +27,7 @@
  // Dalton Altstaetter - DEA528 February 3, 2015
 #include <stdint.h>
 #include "tm4c123gh6pm.h"
+#include "OS.h"
 #define NVIC_EN0_INT17          0x00020000  // Interrupt 17 enable
 
 #define TIMER_CFG_16_BIT        0x00000004  // 16-bit timer configuration,
@@ -69,8 +70,8 @@
 
 void DisableInterrupts(void); // Disable interrupts
 void EnableInterrupts(void);  // Enable interrupts
-long StartCritical (void);    // previous I bit, disable interrupts
-void EndCritical(long sr);    // restore I bit to previous value
+long StartCritical (void);    // previous BASEPRI, mask the kernel interrupt band
+void EndCritical(long sr);    // restore BASEPRI to previous value
 void WaitForInterrupt(void);  // low power mode
 
 // There are many choices to make when using the ADC, and many
@@ -107,6 +108,12 @@ void WaitForInterrupt(void);  // low power mode
 // SS3 triggering event: Timer0A
 // SS3 1st sample source: programmable using variable 'channelNum' [0:11]
 // SS3 interrupts: enabled and promoted to controller
+// SS3 interrupt runs in the zero-latency band (priority ADCPRI) and only
+// takes the sample, it pends the unused SS2 interrupt at OS_KERNELPRI
+// which passes the samples to task, so kernel critical sections never
+// delay a sample and task can still call the OS
+#define ADCPRI 0            // above OS_KERNELPRI, never masked by the kernel
+#define ADCRINGSIZE 8       // samples SS3 can get ahead of task, power of 2
 
 #define FS 400            // producer/consumer sampling
 #define RUNLENGTH (20*FS) // display results and quit when NumSamples==RUNLENGTH
@@ -116,6 +123,10 @@ void (*ADC_Task)(unsigned long);
 volatile uint32_t NumberOfSamples=0;
 volatile uint16_t* Buffer;
 volatile uint32_t Status=1;
+static volatile uint16_t ADCRing[ADCRINGSIZE];		// SS3 handler to SS2 handler, lock-free
+static volatile uint32_t ADCPutI = 0;		// only SS3 changes it
+static volatile uint32_t ADCGetI = 0;		// only SS2 changes it
+unsigned long ADCOverruns = 0;		// samples dropped because the ring was full
 //void ADC_Collect(uint8_t channelNum, uint32_t fs, uint16_t buffer[],uint32_t numberOfSamples){
 void ADC_Collect(uint8_t channelNum, uint32_t fs, void(*task)(unsigned long)){
   volatile uint32_t delay;
@@ -235,18 +246,35 @@ void ADC_Collect(uint8_t channelNum, uint32_t fs, void(*task)(unsigned long)){
   ADC0_SSCTL3_R = 0x06;          // set flag and end                       
   ADC0_IM_R |= 0x08;             // enable SS3 interrupts
   ADC0_ACTSS_R |= 0x08;          // enable sample sequencer 3
-  NVIC_PRI4_R = (NVIC_PRI4_R&0xFFFF00FF)|0x00000000; //priority 2
-  NVIC_EN0_R = 1<<17;              // enable interrupt 17 in NVIC
+  NVIC_PRI4_R = (NVIC_PRI4_R&0xFFFF0000)|(ADCPRI<<13)|(OS_KERNELPRI<<5); // SS3 zero-latency, SS2 kernel band
+  NVIC_EN0_R = (1<<17)|(1<<16);    // enable interrupts 17 and 16 (pended by software) in NVIC
 	ADC_Task = task;
   EnableInterrupts();
 }
 volatile uint32_t ADCvalue;
+// zero-latency band, no OS calls, TRACE or critical sections here
 void ADC0Seq3_Handler(void){
-	static int i=0;
-	long sr;
+	uint32_t data;
   ADC0_ISC_R = 0x08;          // acknowledge ADC sequence 3 completion
-	sr = StartCritical();
- (*ADC_Task)(ADC0_SSFIFO3_R);
+	data = ADC0_SSFIFO3_R;
+	if((ADCPutI - ADCGetI) < ADCRINGSIZE){
+		ADCRing[ADCPutI&(ADCRINGSIZE-1)] = data;
+		ADCPutI++;
+	}else{
+		ADCOverruns++;
+	}
+	NVIC_PEND0_R = 1<<16;       // ADC0Seq2_Handler passes it on
+}
+
+// kernel band, pended by ADC0Seq3_Handler, runs the task for every sample in the ring
+void ADC0Seq2_Handler(void){
+	uint32_t data;
+	TRACE(ISRENTRY,NULL,32);		// ADC0 sequencer 2 is vector 32
+	while(ADCGetI != ADCPutI){
+		data = ADCRing[ADCGetI&(ADCRINGSIZE-1)];
+		ADCGetI++;
+		(*ADC_Task)(data);
+	}
 	if(NumSamples >= RUNLENGTH)
 	{
 		Status=1;							//ADC conversion complete
@@ -256,15 +284,6 @@ void ADC0Seq3_Handler(void){
 	{
 		Status = 0;
 	}
-	
-//	if(i==NumberOfSamples){
-//		Status=1;							//ADC conversion complete
-//		ADC0_IM_R &= ~0x08;             // disable SS3 interrupts when buffer is full
-//	}else{
-//		Status=0;							//ADC still filling buffer
-//		i++;
-//	}
-	EndCritical(sr);
 }
 
 int ADC_Status(void){
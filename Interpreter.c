@@ -117,8 +117,10 @@ void Interpreter(void){
 	printf("LCD\n\r");
 	printf("OS-K - Kill the Interpreter\n\r");
 	#ifdef PROFILER
-	printf("PROFILE - get profiling info for past events\n\r");
+	printf("PROFILE - dump the kernel trace (decode with host/trace2json)\n\r");
+	printf("CRIT - worst interrupt masking call sites with histograms, then start over\n\r");
 	#endif
+	printf("STATS - CPU usage per thread, EDF deadlines, interrupt response times, Fifo, pool and work queue fill levels\n\r");
 	printf("FORMAT - format the file system\n\r");
 	printf("LS - prints directory\n\r");
 	printf("CAT - prints file contents");
@@ -147,11 +149,20 @@ void Interpreter(void){
 			OS_Kill();
 			#ifdef PROFILER
 		} else if(!strcmp(input_str,"PROFILE")){
-			printf("\n\rThreadAddress\tThreadAction\tThreadTime\n\r");
-			for(i=0; i<PROFSIZE; i++){
-				printf("%lu\t\t%lu\t\t%lu\n\r",(unsigned long)ThreadArray[i],ThreadAction[i],ThreadTime[i]/80000);
-			}
+			printf("\n\r");
+			OS_TraceDump();
+		} else if(!strcmp(input_str,"CRIT")){
+			printf("\n\r");
+			OS_CritReport(5);
+			OS_CritReset();
 			#endif 
+		} else if(!strcmp(input_str,"STATS")){
+			OS_ThreadStats();
+			OS_EDFReport();
+			OS_RtaReport();
+			OS_FifoReport();
+			OS_PoolReport();
+			OS_WorkReport();
 		} else if(!strcmp(input_str,"FORMAT")){
 				eFile_Format();
 		} else if(!strcmp(input_str,"LS")){
@@ -24,6 +24,14 @@ uint32_t IntTerm;
 uint32_t PrevError;
 
 int Running;                // true while robot is running
+#define ROBOTFIFOSIZE 512   // samples, must be a power of 2
+unsigned short RobotBuf[ROBOTFIFOSIZE];
+OSFifoType* RobotFifo;      // ADC samples from Producer to Robot
+#define ROBOTBATCH 10       // samples per wakeup, 10ms at 1 kHz is the resolution printed
+#define ROBOTTIMEOUT 1000   // ms without a sample before Robot gives up on the ADC
+OSEventGroupType RobotEvents;  // what the Robot thread waits for
+#define ROBOTDATA 0x01      // a batch of samples is in RobotFifo
+#define ROBOTSTOP 0x02      // down switch asked the Robot to stop early
 
 #define TIMESLICE 2*TIME_1MS  // thread switch time in system time units
 
@@ -45,9 +53,12 @@ int Running;                // true while robot is running
 // inputs:  none
 // outputs: none
 void Robot(void){   
+unsigned short samples[ROBOTBATCH];   // ADC samples as sent by Producer
+unsigned long n,j;
+uint32_t events;
 unsigned long data;      // ADC sample, 0 to 1023
 unsigned long voltage;   // in mV,      0 to 3000
-unsigned long time;      // in 10msec,  0 to 1000 
+unsigned long time;      // in msec,  0 to 10000 
 unsigned long t=0;
 	int i;
 	char ch;
@@ -59,14 +70,29 @@ unsigned long t=0;
   printf("Robot running...");
   eFile_RedirectToFile("Robot");
   printf("time(sec)\tdata(volts)\n\r");
+  OS_EventClear(&RobotEvents,ROBOTDATA|ROBOTSTOP);   // a stop left over from the last run
   do{
     t++;
-    time = OS_MsTime();            // 10ms resolution in this OS
-    data = OS_Fifo_Get();        // 1000 Hz sampling get from producer
-    voltage = (300*data)/1024;   // in mV
-    printf("%0u.%02u\t%0u.%03u\n\r",time/100,time%100,voltage/1000,voltage%1000);
+    events = OS_EventWait(&RobotEvents,ROBOTDATA|ROBOTSTOP,OS_EVENT_CLEAR,ROBOTTIMEOUT); // one wakeup per batch from producer
+    time = OS_MsTime();            // 1ms resolution in this OS
+    if(events == 0){
+      printf("ADC stopped\n\r");
+      break;
+    }
+    if(events&ROBOTSTOP){
+      printf("stopped\n\r");
+      break;
+    }
+    while(OS_FifoSize(RobotFifo) >= ROBOTBATCH){
+      n = OS_FifoGetBlockTimeout(RobotFifo,samples,ROBOTBATCH,ROBOTBATCH,0);
+      for(j=0; j<n; j++){
+        data = samples[j];
+        voltage = (300*data)/1024;   // in mV
+        printf("%0u.%02u\t%0u.%03u\n\r",time/1000,(time%1000)/10,voltage/1000,voltage%1000);
+      }
+    }
   }
-  while(time < 10000);       // change this to mean 10 seconds
+  while(time < 10000);       // 10 seconds
   eFile_EndRedirectToFile();
   printf("done.\n\r");
 	eFile_ROpen("Robot");
@@ -84,14 +110,16 @@ unsigned long t=0;
 void ButtonPush(void){
   if(Running==0){
     Running = 1;  // prevents you from starting two robot threads
-    NumCreated += OS_AddThread(&Robot,128,1);  // start a 20 second run
+    NumCreated += OS_AddThread(&Robot,512,1);  // start a 20 second run
   }
 }
 //************DownPush*************
 // Called when Down Button pushed
 // background threads execute once and return
 void DownPush(void){
-
+  if(Running){
+    OS_EventSet(&RobotEvents,ROBOTSTOP);
+  }
 }
 
 
@@ -107,8 +135,11 @@ void DownPush(void){
 // outputs: none
 void Producer(unsigned short data){  
   if(Running){
-    if(OS_Fifo_Put(data)){     // send to Robot
+    if(OS_FifoPut(RobotFifo,&data)){  // send to Robot
       NumSamples++;
+      if(OS_FifoSize(RobotFifo) >= ROBOTBATCH){
+        OS_EventSet(&RobotEvents,ROBOTDATA);
+      }
     } else{ 
       DataLost++;
     } 
@@ -121,9 +152,11 @@ void Producer(unsigned short data){
 // inputs:  none
 // outputs: none
 unsigned long Idlecount=0;
+void WaitForInterrupt(void);  // low power mode, in startup.s
 void IdleTask(void){ 
   while(1) { 
     Idlecount++;        // debugging 
+    WaitForInterrupt(); // in tickless mode the next SysTick may be far away
   }
 }
 
@@ -149,7 +182,8 @@ int main(void){        // lab 5 real main
   NumSamples = 0;
 
 //********initialize communication channels
-  OS_Fifo_Init(512);    // ***note*** 4 is not big enough*****
+  RobotFifo = OS_FifoCreate(RobotBuf,ROBOTFIFOSIZE,sizeof(unsigned short));
+  OS_InitEventGroup(&RobotEvents);
   ADC_Collect(4, 1000, &Producer); // start ADC sampling, channel 4, PD3, 12800 Hz  
 
 //*******attach background tasks***********
@@ -159,8 +193,8 @@ int main(void){        // lab 5 real main
 	
   NumCreated = 0 ;
 // create initial foreground threads
-  NumCreated += OS_AddThread(&Interpreter,128,2); 
-  NumCreated += OS_AddThread(&IdleTask,128,7);  // runs when nothing useful to do
+  NumCreated += OS_AddThread(&Interpreter,512,2); 
+  NumCreated += OS_AddThread(&IdleTask,256,7);  // runs when nothing useful to do
  
   OS_Launch(TIMESLICE); // doesn't return, interrupts enabled in here
   return 0;             // this never executes
@@ -209,7 +243,7 @@ void TestDisk(void){  DSTATUS result;  unsigned short block;  int i; unsigned lo
   OS_Kill();
 }
 void RunTest(void){
-  NumCreated += OS_AddThread(&TestDisk,128,1);  
+  NumCreated += OS_AddThread(&TestDisk,512,1);  
 }
 //******************* test main1 **********
 // SYSTICK interrupts, period established by OS_Launch
@@ -223,8 +257,8 @@ int testmain1(void){   // testmain1
   
   NumCreated = 0 ;
 // create initial foreground threads
-  NumCreated += OS_AddThread(&TestDisk,128,1);  
-  NumCreated += OS_AddThread(&IdleTask,128,3); 
+  NumCreated += OS_AddThread(&TestDisk,512,1);  
+  NumCreated += OS_AddThread(&IdleTask,256,3); 
  
   OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
   return 0;               // this never executes
@@ -270,8 +304,8 @@ int testmain2(void){
   
   NumCreated = 0 ;
 // create initial foreground threads
-  NumCreated += OS_AddThread(&TestFile,128,1);  
-  NumCreated += OS_AddThread(&IdleTask,128,3); 
+  NumCreated += OS_AddThread(&TestFile,512,1);  
+  NumCreated += OS_AddThread(&IdleTask,256,3); 
  
   OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
   return 0;               // this never executes
@@ -318,8 +352,149 @@ void FileSystemTesting(void){
 int testmain3(void){
 	OS_Init();
 	UART_Init();
-	OS_AddThread(&FileSystemTesting,128,1);
-	OS_AddThread(&IdleTask,128,3);
+	OS_AddThread(&FileSystemTesting,512,1);
+	OS_AddThread(&IdleTask,256,3);
 	OS_Launch(10*TIME_1MS);
 	return 0;
 }
+
+//******************* test main4 **********
+// benchmark for the eFile write-back cache
+// logs CACHEBYTES bytes one at a time and reports how many blocks went to the disk
+// without the cache every byte cost one block read and one block write
+#define CACHEBYTES 10240
+void TestFileCache(void){ int i; unsigned long hits, flushes, start, time;
+  printf("\n\rEE345M/EE380L, Lab 5 eFile write-back cache test\n\r");
+  if(eFile_Init())             diskError("eFile_Init",0); 
+  if(eFile_Format())            diskError("eFile_Format",0); 
+  if(eFile_Create("cache"))     diskError("eFile_Create",0);
+  if(eFile_WOpen("cache"))      diskError("eFile_WOpen",0);
+  eFile_CacheStats(&hits,&start);   // only count the write backs made by this test
+  time = OS_MsTime();
+  for(i=0;i<CACHEBYTES;i++){
+    if(eFile_Write('a'+i%26))   diskError("eFile_Write",i);
+  }
+  if(eFile_WClose())            diskError("eFile_WClose",0);
+  time = OS_MsTime() - time;
+  eFile_CacheStats(&hits,&flushes);
+  flushes -= start;
+  printf("%u bytes in %u ms, %u block writes\n\r",CACHEBYTES,time,flushes);
+  printf("%u bytes per disk write, uncached was 2 transactions per byte\n\r",CACHEBYTES/flushes);
+  OS_Kill();
+}
+int testmain4(void){
+  OS_Init();
+  UART_Init();
+  NumCreated = 0 ;
+  NumCreated += OS_AddThread(&TestFileCache,512,1);  
+  NumCreated += OS_AddThread(&IdleTask,256,3); 
+  OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
+  return 0;               // this never executes
+}
+
+//******************* test main5 **********
+// benchmark for the sleeping list, needs PROFILER defined in OS.h
+// measures the SysTick wakeup time with 1, 5 and 19 threads asleep
+// TestSleepQueue counts as one of the sleeping threads while it waits
+unsigned long SleepCounts[3] = {1,5,19};
+void Sleeper(void){
+  while(1){
+    OS_Sleep(60000);    // stays on the sleeping list for the whole test
+  }
+}
+void TestSleepQueue(void){ int i; unsigned long n=1;
+  printf("\n\rEE345M/EE380L, Lab 5 sleeping list test\n\r");
+  for(i=0;i<3;i++){
+    while(n<SleepCounts[i]){
+      NumCreated += OS_AddThread(&Sleeper,256,2);
+      n++;
+    }
+    OS_Sleep(20);         // let the new sleepers run and go to sleep
+    SysTickMaxCycles = 0;
+    OS_Sleep(500);
+    printf("%u sleeping: SysTick %u cycles, max %u cycles\n\r",n,SysTickCycles,SysTickMaxCycles);
+  }
+  OS_Kill();
+}
+int testmain5(void){
+  OS_Init();
+  UART_Init();
+  NumCreated = 0 ;
+  NumCreated += OS_AddThread(&TestSleepQueue,512,1);  
+  NumCreated += OS_AddThread(&IdleTask,256,3); 
+  OS_Launch(TIMESLICE); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+
+//******************* test main6 **********
+// benchmark for the semaphore blocked lists
+// measures OS_Signal to wakeup latency with 1 to 19 threads blocked
+// waiters have mixed priorities, all higher than TestSemaQueue
+Sema4Type BenchSema4;
+unsigned long SignalTime, WakeLatency;
+void Waiter(void){
+  while(1){
+    OS_Wait(&BenchSema4);
+    WakeLatency = OS_TimeDifference(SignalTime,OS_Time());
+  }
+}
+void TestSemaQueue(void){ unsigned long n=0, i, max;
+  printf("\n\rEE345M/EE380L, Lab 5 semaphore wakeup test\n\r");
+  OS_InitSemaphore(&BenchSema4,0);
+  while(n<19){
+    NumCreated += OS_AddThread(&Waiter,256,1+n%3);
+    n++;
+    OS_Sleep(20);         // let the new waiter run and block
+    max = 0;
+    for(i=0;i<100;i++){
+      SignalTime = OS_Time();
+      OS_Signal(&BenchSema4);   // highest priority waiter runs, measures and blocks again
+      if(WakeLatency > max){max = WakeLatency;}
+    }
+    printf("%u waiters: signal to wakeup %u cycles, max %u cycles\n\r",n,WakeLatency,max);
+  }
+  OS_Kill();
+}
+int testmain6(void){
+  OS_Init();
+  UART_Init();
+  NumCreated = 0 ;
+  NumCreated += OS_AddThread(&TestSemaQueue,512,4);  
+  NumCreated += OS_AddThread(&IdleTask,256,7); 
+  OS_Launch(TIMESLICE); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+
+//******************* test main7 **********
+// benchmark for context switch time with CPU time accounting
+// two threads at the same priority hand the CPU back and forth with OS_Suspend
+// the time per loop is two switches through PendSV_Handler plus the OS_Suspend calls
+// run it again with NOACCOUNTING in the Asm defines, the drop per switch is the
+// cost of the accounting (20 cycles on the host sim, fpu 0: 194 against 174)
+#define SWITCHLOOPS 10000
+void Switcher(void){
+  while(1){
+    OS_Suspend(0);
+  }
+}
+void TestSwitchTime(void){ unsigned long i, start, time;
+  printf("\n\rEE345M/EE380L, Lab 5 context switch test\n\r");
+  NumCreated += OS_AddThread(&Switcher,256,1);
+  start = OS_Time();
+  for(i=0;i<SWITCHLOOPS;i++){
+    OS_Suspend(0);
+  }
+  time = OS_TimeDifference(start,OS_Time());
+  printf("%u cycles per switch\n\r",time/(2*SWITCHLOOPS));
+  OS_ThreadStats();
+  OS_Kill();
+}
+int testmain7(void){
+  OS_Init();
+  UART_Init();
+  NumCreated = 0 ;
+  NumCreated += OS_AddThread(&TestSwitchTime,512,1);  
+  NumCreated += OS_AddThread(&IdleTask,256,7); 
+  OS_Launch(TIMESLICE); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
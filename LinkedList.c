@@ -65,95 +65,160 @@ int LLRemove(tcbType** first, tcbType* insert, tcbType** last){
 }
 
 
-// insert into the sema4 linked list, insert at back of list
-// need to modify this for a priority sema4Add
-void Sem4LLAdd(tcbType** ptFrontPt,tcbType* insert,tcbType** ptEndPt)
-{
-	LLAdd(ptFrontPt,insert,ptEndPt);
-	
 /*
-	if(*ptFrontPt == NULL) // when the sem4 LL is initially empty and you add the first element
-	{
-		(*ptFrontPt) = insert; // set frontpt to the first element
-		(*ptEndPt) = insert; // set endpt to first element
-		
-		// might be necessary if this ever becomes a front or end of the list
-		(*ptFrontPt)->next = NULL;
-		
-		(*ptEndPt)->next = NULL;
-		(*ptEndPt)->previous = NULL;
-		
+Adds a tcb to the sleeping linked list, kept in order of wakeup time
+Each SleepCtr holds the time left after the thread in front of it wakes up,
+so only the front of the list has to be decremented every SysTick
+The list is linked through SlpNext/SlpPrevious, so a thread in a timed wait
+can be on a semaphore's blocked list and the sleeping list at the same time
+Called by OS_Sleep, OS_WaitTimeout
+Inputs: first - pointer to a pointer to the first element in the linked list
+        insert - tcb to be inserted, SleepCtr holds its total sleep time
+				last - pointer to a pointer to the last element in the linked list
+Outputs: none
+*/
+void SlpLLAdd(tcbType** first, tcbType* insert, tcbType** last){
+	tcbType* iterator;
+	if(*first==NULL){
+		*first=insert;
+		*last=insert;
+		insert->SlpNext=insert;
+		insert->SlpPrevious=insert;
+		return;
 	}
-	else if (*ptFrontPt == *ptEndPt) // when there is one element in LL and you add the 2nd
-	{
-		(*ptFrontPt)->next = insert; // update the LL to point to the next element
-		(*ptEndPt) = insert; // set the endpt to the element just inserted
-		
-		// added for the removing of the thread 
-		(*ptEndPt)->previous = *(ptFrontPt); // point the end back to the front
-		(*ptEndPt)->next = NULL; // set endPt->next to null
-		
+	iterator=*first;
+	do{
+		if(insert->SleepCtr < iterator->SleepCtr){	//wakes up before iterator, insert in front of it
+			iterator->SleepCtr -= insert->SleepCtr;
+			insert->SlpNext=iterator;
+			insert->SlpPrevious=iterator->SlpPrevious;
+			iterator->SlpPrevious->SlpNext=insert;
+			iterator->SlpPrevious=insert;
+			if(iterator==*first){
+				*first=insert;
+			}
+			return;
+		}
+		insert->SleepCtr -= iterator->SleepCtr;		//equal wakeup times stay in FIFO order
+		iterator=iterator->SlpNext;
+	}while(iterator!=*first);
+	insert->SlpNext=*first;			//wakes up after everything else
+	insert->SlpPrevious=*last;
+	(*last)->SlpNext=insert;
+	(*first)->SlpPrevious=insert;
+	*last=insert;
+}
+
+/*
+Removes a tcb from anywhere in the sleeping linked list
+The time it was holding is handed to the thread behind it
+Called by OS_WakeUpSleeping, and by OS_Signal when a timed wait is signaled
+Inputs: first - pointer to a pointer to the first element in the linked list
+        remove - pointer to element to be removed
+				last - pointer to a pointer to the last element in the linked list
+Outputs: 1 if the linked list is empty after removal
+				 0 if the linked list is not empty after removal
+*/
+int SlpLLRemove(tcbType** first, tcbType* remove, tcbType** last){
+	if(*first==*last){		//it was the only one
+		*first=NULL;
+		*last=NULL;
+		return 1;
 	}
-	else // general case when there is 2 or more elements and you add to a list, insert at the back for round robin
-	{
-		(*ptEndPt)->next = insert; // add to end of the LL
-		insert->previous = (*ptEndPt); // point the inserted node (the new End) to the old end
-		insert->next = NULL; // mght be necessary if this ever becomes the fron of the list & we are checking for null
-		(*ptEndPt) = insert; // update EndPt to be the new back of the list
+	if(*last==remove){
+		*last=remove->SlpPrevious;
+	}else{
+		remove->SlpNext->SleepCtr += remove->SleepCtr;
+		if(*first==remove){
+			*first=remove->SlpNext;
+		}
 	}
-	*/
+	remove->SlpPrevious->SlpNext=remove->SlpNext;
+	remove->SlpNext->SlpPrevious=remove->SlpPrevious;
+	return 0;
 }
 
+// insert into the sema4 linked list, kept in priority order
+// the new thread goes behind every thread of equal or higher priority, so the
+// front of the list is always the longest waiting highest priority thread
+// Called by OS_Wait
+// Inputs: ptFrontPt - pointer to the FrontPt of the semaphore
+//         insert - tcb to be blocked
+//         ptEndPt - pointer to the EndPt of the semaphore
+// Outputs: none
+void Sem4LLAdd(tcbType** ptFrontPt,tcbType* insert,tcbType** ptEndPt)
+{
+	tcbType* iterator;
+	if(*ptFrontPt == NULL)
+	{
+		LLAdd(ptFrontPt,insert,ptEndPt);
+		return;
+	}
+	iterator = *ptFrontPt;
+	do{
+		if(insert->Priority < iterator->Priority)
+		{	// first thread of lower priority, insert in front of it
+			insert->next = iterator;
+			insert->previous = iterator->previous;
+			iterator->previous->next = insert;
+			iterator->previous = insert;
+			if(iterator == *ptFrontPt)
+			{
+				*ptFrontPt = insert;
+			}
+			return;
+		}
+		iterator = iterator->next;
+	}while(iterator != *ptFrontPt);
+	LLAdd(ptFrontPt,insert,ptEndPt);		// lowest priority in the list, add to the back
+}
 
+// insert into the EDFPRI active list, kept in order of absolute deadline
+// so the front is always the job that is due first
+// a thread that is not in the EDF class (one that inherited priority
+// EDFPRI from a mutex) sorts after every EDF thread
+// Called by OS_ActiveAdd
+// Inputs: first - pointer to FrontOfPriLL[EDFPRI]
+//         insert - tcb to be made ready
+//         last - pointer to EndOfPriLL[EDFPRI]
+// Outputs: none
+void EDFLLAdd(tcbType** first, tcbType* insert, tcbType** last){
+	tcbType* iterator;
+	if((*first==NULL)||(insert->EDF==NULL)){
+		LLAdd(first,insert,last);
+		return;
+	}
+	iterator = *first;
+	do{
+		if((iterator->EDF==NULL)||((int32_t)(insert->EDF->Deadline - iterator->EDF->Deadline) < 0)){
+			insert->next = iterator;		// due before iterator, insert in front of it
+			insert->previous = iterator->previous;
+			iterator->previous->next = insert;
+			iterator->previous = insert;
+			if(iterator == *first){
+				*first = insert;
+			}
+			return;
+		}
+		iterator = iterator->next;
+	}while(iterator != *first);
+	LLAdd(first,insert,last);		// due last, add to the back
+}
 
 // remove from the sema4 linked list, remove at front of list
-// corner case when there are 2 elements, 1 element and no elements
-
+// the list is kept in priority order by Sem4LLAdd so this is O(1)
+// Called by OS_Signal
+// Inputs: semaphore the thread is blocked on
+// Outputs: highest priority thread that was blocked, NULL if none
 tcbType* Sem4LLARemove(Sema4Type *semaPt)
 {
 	tcbType* wakeupThread;
-	tcbType* temp;
-	int32_t tempHighPri;
-	int32_t linkListStatus;
-	
-	// we need to traverse the whole linked list
-	
-	// ** what if I removed a thread that was at the end
-	// what if I removed a thread that was at the beginning
-	// what if I keep removing from front s.t. frontpt == endpt
-	// what if I keep removing from the end s.t. frontpt == endpt
 	
 	if(semaPt->FrontPt == NULL)						//no elements in the blocked list
 	{	// LL is empty, return
 		return NULL;
 	}
 	wakeupThread = semaPt->FrontPt;
-	if(semaPt->FrontPt==semaPt->EndPt){			//one thread in the blocked list
-		linkListStatus = LLRemove(&semaPt->FrontPt,wakeupThread,&semaPt->EndPt);
-		return wakeupThread;
-	}		
-	
-	tempHighPri=semaPt->FrontPt->Priority;
-	for(temp = semaPt->FrontPt; temp!=semaPt->EndPt; temp = temp->next)		//more than 1 element in the blocked list
-	{
-		if(tempHighPri < temp->Priority)
-		{	// we found a higher priority thread,
-			// this gets the longest waiting highest priority thread since it picks only the 1st
-			// thread at the highest priority level
-			tempHighPri = temp->Priority; // update tempHighPri 
-			wakeupThread = temp; // wakeupThread(holds highest pri thread we found at current time)
-		} 
-	}
-	if(tempHighPri < semaPt->EndPt->Priority){
-		wakeupThread=temp;		
-	}else{
-		wakeupThread = semaPt->EndPt;
-	}
-	// we now have the highest priority thread, return thread & update LL
-	// I need it to be doubly linked to get the previous
-	// returns 1 if empty after removal 0 if not empty after removal
-	
+	LLRemove(&semaPt->FrontPt,wakeupThread,&semaPt->EndPt);
 	return wakeupThread;
 }
-
-
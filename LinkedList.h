@@ -3,12 +3,23 @@ int LLAdd(tcbType** first, tcbType* insert, tcbType** last);
 
 int LLRemove(tcbType** first, tcbType* insert, tcbType** last);
 
+// insert into the sleeping linked list in order of wakeup time
+// SleepCtr of each tcb becomes the delta from the tcb in front of it
+void SlpLLAdd(tcbType** first, tcbType* insert, tcbType** last);
 
-// insert into the sema4 linked list, insert at back of list
-// need to modify this for a priority sema4Add
+// remove from anywhere in the sleeping linked list, keeping the deltas behind it
+int SlpLLRemove(tcbType** first, tcbType* remove, tcbType** last);
+
+// insert into the sema4 linked list in priority order
+// FIFO order among threads of the same priority
 void Sem4LLAdd(tcbType** ptFrontPt,tcbType* insert,tcbType** ptEndPt);
 
+// insert into an EDF priority bin in order of absolute deadline
+// FIFO order among equal deadlines, threads not in the EDF class go last
+void EDFLLAdd(tcbType** first, tcbType* insert, tcbType** last);
+
 // remove from the sema4 linked list, remove at front of list
+// returns the highest priority thread that was blocked, NULL if none
 tcbType* Sem4LLARemove(Sema4Type *semaPt);
 
 
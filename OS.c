@@ -7,34 +7,42 @@
 #include "tm4c123gh6pm.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "PLL.h"
 #include "TIMER.h"
 #include "ifdef.h"
 #include "LinkedList.h"
+#ifdef HOSTSIM
+#include "sim.h"
+#endif
 
 // function definitions in osasm.s
 void OS_DisableInterrupts(void); // Disable interrupts
 void OS_EnableInterrupts(void);  // Enable interrupts
-int32_t StartCritical(void);
-void EndCritical(int32_t primask);
+int32_t StartCritical(void);		// weak, the PROFILER build times them here instead
+void EndCritical(int32_t basepri);
 void PendSV_Handler(); // used for context switching in SysTick
+int Sema4TryDecrement(long* value);	// LDREX/STREX fast paths in osasm.s
+int Sema4TryIncrement(long* value);
 void StartOS(void);
 
-unsigned long ThreadTime[PROFSIZE];
-unsigned long ThreadAction[PROFSIZE];
-tcbType* ThreadArray[PROFSIZE];
-unsigned long ThreadCount = 0;
-unsigned long DisableTime = 0;
-unsigned long DisableTimeTemp = 0;
-unsigned long multAccDisTime = 0;
+struct traceRecord TraceBuffer[TRACESIZE];
+uint32_t TraceCount = 0;			// records written, the next one goes in TraceBuffer[TraceCount&(TRACESIZE-1)]
+uint64_t TraceLastTime = 0;		// OS_Time64 value of the last record
+uint32_t TraceStopped = 0;		// 1 while OS_TraceDump is printing
+unsigned long SysTickCycles = 0;			// time spent waking sleepers in the last SysTick, 12.5ns units
+unsigned long SysTickMaxCycles = 0;
+#ifdef PROFILER
+unsigned long CPUbasepriGet(void);		// cpu.c
+void CPUbasepriSet(unsigned long newBasepri);
+critSiteType CritSites[CRITSITES];		// open addressed by call site
+uint32_t CritOverflow = 0;						// sections not counted because every slot was taken
+uint32_t CritSite = 0;								// call site of the open outermost section
+unsigned long CritStart = 0;					// OS_Time when it masked
+#endif
 
 
 unsigned long startTime = 0;
-#define THREADSUSPEND 0
-#define THREADKILL 		1
-#define THREADSLEEP 	2
-#define THREADWAKERUN	3
-#define THREADSWITCH 	4
 volatile uint32_t* Timer1_TAILR_Ptr = ((volatile uint32_t *)0x40031028); 
 volatile uint32_t* Timer1_TAR_Ptr = ((volatile uint32_t *)0x40031048);
 
@@ -55,11 +63,13 @@ volatile uint32_t* Timer1_TAR_Ptr = ((volatile uint32_t *)0x40031048);
 #define JMP2HIGHERPRI	1				//next thread will be one at a higher priority
 #define JMPOVER	2							//current thread was blocked, put to sleep, or killed, so jump to the thread after it
 
-#define NUMTHREADS 20
-#define STACKSIZE 128
+#define NUMTHREADS 32
+#define STACKPOOLSIZE 2560		//words of RAM shared by all thread stacks (10 KB)
+#define MINSTACKSIZE 64				//smallest stack handed out, in words (room for ISR frames)
+#define EXCRETURNNOFP 0xFFFFFFF9	//back to thread mode on the main stack with a basic frame, no FP context yet
 
 
-#define SYSTICK_PERIOD 10 //Systick interrupts every 2 ms so decrement sleep counters by 2
+#define MINRELOAD 100 //shortest SysTick period programmed in tickless mode, in bus cycles
 //Priority Array of Round-Robin Linked Lists
 tcbType* FrontOfPriLL[NUMPRI];
 tcbType* EndOfPriLL[NUMPRI];
@@ -76,44 +86,217 @@ tcbType* NextThread = NULL;
 
 tcbType tcbs[NUMTHREADS];
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+int32_t StackPool[STACKPOOLSIZE];
+tcbType* KilledThread = NULL;	// killed thread whose stack is still in use until PendSV switches away
+
+// free stack blocks are kept in address order, the header
+// lives in the first two words of each free block
+struct freeStack{
+	uint32_t Size;							// words in this free block
+	struct freeStack* Next;			// next free block at a higher address
+};
+struct freeStack* FreeStacks;
 
 Sema4Type g_mailboxDataValid, g_mailboxFree;
-Sema4Type g_dataAvailable, g_roomLeft, g_fifoMutex;
-unsigned long g_msTime; // num of ms since SysTick has started counting
 
-#define FIFOMAXSIZE 128
+//64-bit time base, see OS_Time64
+uint32_t g_Timer1Wraps = 0;				// Timer1 rollovers seen so far, the upper 32 bits of OS_Time64
+uint32_t g_LastTimer1 = 0xFFFFFFFF;	// Timer1 value at the last OS_Time64 call
+uint64_t g_MsTimeBase = 0;				// OS_Time64 value at the last OS_ClearMsTime
+uint64_t g_SleepTime = 0;					// OS_Time64 value the sleeping list has been counted down to, whole ms
+static void OS_SleepCatchUp(uint64_t now);
+#ifndef HOSTSIM		// osasm.s reaches into the tcb by offset, break the build if they drift
+typedef char TcbRunTimeOffsetCheck[(offsetof(struct tcb,RunTime)==TCB_RUNTIME)?1:-1];
+typedef char TcbLastRunOffsetCheck[(offsetof(struct tcb,LastRun)==TCB_LASTRUN)?1:-1];
+typedef char TcbSwitchesOffsetCheck[(offsetof(struct tcb,SwitchCount)==TCB_SWITCHES)?1:-1];
+#endif
+
+//Software timers, see OS_TimerCreate
+#define NUMSWTIMERS 256			// software timers OS_TimerCreate can hand out
+#define SWTIMERPRI 2				// NVIC priority of Wide Timer 0A, shared by all of them
+#define MINTIMERCYCLES 100	// shortest one-shot programmed, in bus cycles
+#define MAXTIMERUS 26000000	// periods stay under half the Timer1 wrap so expiry times compare
+#define CYCLESPERUS (TIME_1MS/1000)
+OSTimerType SwTimers[NUMSWTIMERS];
+OSTimerType* TimerHeap[NUMSWTIMERS];	// binary min-heap on Expiry, TimerHeap[0] is due next
+uint32_t g_NumTimersQueued = 0;
+unsigned long g_TimerOverruns = 0;	// periods skipped because a timer fell a whole period behind
+static void OS_TimerHandler(void);
+
+//Response time analysis, see OS_AdmitPeriodicThread
+#define NUMLOADS 16					// periodic interrupt loads it can know about
+#define ISRNEST 8						// interrupt nesting OS_ISREnter can follow, one per NVIC priority
+OSLoadType Loads[NUMLOADS];
+uint32_t g_NumLoads = 0;
+uint32_t g_ISRStart[ISRNEST];		// OS_TimerNow at each nested OS_ISREnter
+uint32_t g_ISRBefore[ISRNEST];		// g_ISRCycles then
+uint32_t g_ISRDepth = 0;
+uint32_t g_ISRCycles = 0;				// cycles spent in measured handlers, nested ones included
+// exception number of each timer OS_AddPeriodicThread can use
+static const uint8_t TimerVector[12] = {35,36,37,38,39,40,51,52,86,87,108,109};
+
+//Earliest deadline first class, see OS_AddEDFThread
+#define NUMEDF 8						// EDF threads OS_AddEDFThread can create
+OSEdfType EDFs[NUMEDF];
+uint32_t g_NumEDF = 0;
+OSTimerType* g_EDFTimer = NULL;	// one-shot, fires at the next release of a waiting EDF thread
+static void OS_BlockRunning(int32_t status, unsigned long timeout, Sema4Type* semaPt);
+static void OS_Ready(tcbType* thread);
+static void OS_Preempt(tcbType* thread, int32_t status);
+static uint32_t OS_TimerNow(void);
+static tcbType* OS_NewThread(void(*task)(void), unsigned long stackSize, unsigned long priority);
+
+//Tickless mode, see OS_LaunchTickless
+uint32_t g_Tickless = 0;					// 1 if SysTick is stretched to the next wakeup when there is nothing to round-robin
+unsigned long g_TimeSlice;				// SysTick period of one time slice, in bus cycles
+uint32_t g_Stretched = 0;					// 1 while SysTick is programmed for longer than a time slice
+
+#define FIFOMAXSIZE 128		// entries behind OS_Fifo_Init, must be a power of 2
 #define FIFO_SUCCESS 1
 #define FIFO_FAIL 0
-unsigned long *g_fifoPutPtr, *g_fifoGetPtr;
-unsigned long Fifo[FIFOMAXSIZE];
-unsigned long* g_Fifo;
-unsigned int g_FIFOSIZE;
+#define NUMFIFOS 8				// handles OS_FifoCreate can give out
+OSFifoType Fifos[NUMFIFOS];
+uint32_t g_NumFifos = 0;
+OSFifoType g_Fifo;				// the one behind OS_Fifo_Init/Put/Get/Size
+
+#define NUMPOOLS 8				// pools OS_PoolCreate can give out
+OSPoolType Pools[NUMPOOLS];
+uint32_t g_NumPools = 0;
+
+//Deferred work, see OS_AddWorker
+#define NUMWORKERS 4				// worker threads OS_AddWorker can create, at most one per priority
+#define WORKQUEUESIZE 16		// items waiting for one worker, must be a power of 2
+#define WORKERSTACK 512			// bytes of stack for each worker thread
+struct workItem{
+	void(*Function)(uint32_t);
+	uint32_t Arg;
+};
+struct workQueue{
+	struct workItem Items[WORKQUEUESIZE];
+	uint32_t PutI;						// free running, written with interrupts disabled
+	uint32_t GetI;						// free running, only the worker writes it
+	Sema4Type ItemsReady;			// one count per item in Items
+	uint32_t Priority;
+	tcbType* Worker;					// NULL until its worker thread first runs
+	uint32_t HighWater;				// most items that were ever waiting at once
+	uint32_t Overflows;				// posts that found the queue full
+};
+struct workQueue WorkQueues[NUMWORKERS];
+uint32_t g_NumWorkers = 0;
+struct workQueue* WorkQueueOfPri[NUMPRI];		// NULL where there is no worker
+unsigned long FifoBuf[FIFOMAXSIZE];
 
 volatile int mutex;
 volatile int RoomLeft;
 volatile int CurrentSize;
-Sema4Type LCDmutex;
+MutexType LCDmutex;
 unsigned long g_mailboxData;
 unsigned long* g_ulFifo; // pointer to OS_FIFO
 
+//**********OS_StackAlloc************
+// carve a stack out of the stack pool, first fit
+// taken from the top of the free block so the block header stays put
+// input:  number of words needed, set to the number handed out, which is
+//         the whole block when the leftover would be under MINSTACKSIZE
+// output: lowest address of the stack, NULL if no free block is big enough
+// called with interrupts disabled
+static int32_t* OS_StackAlloc(uint32_t* words){
+	struct freeStack* block;
+	struct freeStack** link;
+	link = &FreeStacks;
+	for(block=FreeStacks; block!=NULL; block=block->Next){
+		if(block->Size >= *words){
+			if(block->Size - *words < MINSTACKSIZE){		// leftover too small to be useful, hand out the whole block
+				*link = block->Next;
+				*words = block->Size;		// so OS_StackFree gives all of it back
+				return (int32_t*)block;
+			}
+			block->Size -= *words;
+			return (int32_t*)block + block->Size;
+		}
+		link = &block->Next;
+	}
+	return NULL;
+}
+
+//**********OS_StackFree************
+// return a stack to the stack pool, merging it with its free neighbors
+// input:  lowest address and number of words of the stack
+// output: none
+// called with interrupts disabled
+static void OS_StackFree(int32_t* base, uint32_t words){
+	struct freeStack* block;
+	struct freeStack* prev = NULL;
+	struct freeStack* freed = (struct freeStack*)base;
+	for(block=FreeStacks; (block!=NULL)&&(block<freed); block=block->Next){
+		prev = block;
+	}
+	freed->Size = words;
+	freed->Next = block;
+	if((block!=NULL)&&((int32_t*)freed + words == (int32_t*)block)){		// merge with the block above
+		freed->Size += block->Size;
+		freed->Next = block->Next;
+	}
+	if(prev==NULL){
+		FreeStacks = freed;
+	}else if((int32_t*)prev + prev->Size == (int32_t*)freed){		// merge with the block below
+		prev->Size += freed->Size;
+		prev->Next = freed->Next;
+	}else{
+		prev->Next = freed;
+	}
+}
+
+// ******** OS_StackPoolFree ************
+// words free in the stack pool, counts the stack of a killed thread
+// that has not been reclaimed yet
+// Inputs: none
+// Outputs: free words
+unsigned long OS_StackPoolFree(void){
+	struct freeStack* block;
+	unsigned long words = 0;
+	int32_t status;
+	status = StartCritical();
+	for(block=FreeStacks; block!=NULL; block=block->Next){
+		words += block->Size;
+	}
+	if((KilledThread!=NULL)&&(KilledThread!=RunPt)){
+		words += KilledThread->StackSize;
+	}
+	EndCritical(status);
+	return words;
+}
+
+//**********OS_ReclaimKilled************
+// free the TCB and stack of the last killed thread once PendSV has switched away from it
+// called with interrupts disabled
+static void OS_ReclaimKilled(void){
+	if((KilledThread!=NULL)&&(KilledThread!=RunPt)){
+		OS_StackFree(KilledThread->StackBase,KilledThread->StackSize);
+		KilledThread->MemStatus = FREE;
+		KilledThread = NULL;
+	}
+}
+
 void SetInitialStack(int i){
-  tcbs[i].sp = &Stacks[i][STACKSIZE-16]; // thread stack pointer
-  Stacks[i][STACKSIZE-1] = 0x01000000;   // thumb bit
-  Stacks[i][STACKSIZE-3] = 0x14141414;   // R14
-  Stacks[i][STACKSIZE-4] = 0x12121212;   // R12
-  Stacks[i][STACKSIZE-5] = 0x03030303;   // R3
-  Stacks[i][STACKSIZE-6] = 0x02020202;   // R2
-  Stacks[i][STACKSIZE-7] = 0x01010101;   // R1
-  Stacks[i][STACKSIZE-8] = 0x00000000;   // R0
-  Stacks[i][STACKSIZE-9] = 0x11111111;   // R11
-  Stacks[i][STACKSIZE-10] = 0x10101010;  // R10
-  Stacks[i][STACKSIZE-11] = 0x09090909;  // R9
-  Stacks[i][STACKSIZE-12] = 0x08080808;  // R8
-  Stacks[i][STACKSIZE-13] = 0x07070707;  // R7
-  Stacks[i][STACKSIZE-14] = 0x06060606;  // R6
-  Stacks[i][STACKSIZE-15] = 0x05050505;  // R5
-  Stacks[i][STACKSIZE-16] = 0x04040404;  // R4
+	int32_t* top = tcbs[i].StackBase + tcbs[i].StackSize;
+  tcbs[i].sp = &top[-17]; // thread stack pointer
+  top[-1] = 0x01000000;   // thumb bit
+  top[-3] = 0x14141414;   // R14
+  top[-4] = 0x12121212;   // R12
+  top[-5] = 0x03030303;   // R3
+  top[-6] = 0x02020202;   // R2
+  top[-7] = 0x01010101;   // R1
+  top[-8] = 0x00000000;   // R0
+  top[-9] = EXCRETURNNOFP; // EXC_RETURN PendSV_Handler returns with
+  top[-10] = 0x11111111;  // R11
+  top[-11] = 0x10101010;  // R10
+  top[-12] = 0x09090909;  // R9
+  top[-13] = 0x08080808;  // R8
+  top[-14] = 0x07070707;  // R7
+  top[-15] = 0x06060606;  // R6
+  top[-16] = 0x05050505;  // R5
+  top[-17] = 0x04040404;  // R4
 }
 
 // ******** OS_Init ************
@@ -131,7 +314,7 @@ void OS_Init(void){
 	TIMER1_CTL_R &= ~TIMER_CTL_TAEN; // disable TimerA1
 	TIMER1_CFG_R  = TIMER_CFG_32_BIT_TIMER; // configure for 32-bit mode
 	TIMER1_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
-	TIMER1_TAILR_R = 0xFFFFFFFF-1;
+	TIMER1_TAILR_R = 0xFFFFFFFF;		// full 32-bit range, so differences stay exact across a rollover
 	TIMER1_TAPR_R = 0; // set prescale = 0
 	TIMER1_CTL_R |= TIMER_CTL_TAEN; // disable TimerA0
 	#ifdef SYSTICK
@@ -141,7 +324,9 @@ void OS_Init(void){
 	#endif
 	NVIC_SYS_PRI3_R = (NVIC_SYS_PRI3_R&(~NVIC_SYS_PRI3_PENDSV_M))|(0x7 << NVIC_SYS_PRI3_PENDSV_S); // PendSV priority 7
 	//NVIC_SYS_HND_CTRL_R |= NVIC_SYS_HND_CTRL_PNDSV; //enable PendSV
+	TIMER_OneShotInit(&OS_TimerHandler,SWTIMERPRI);		// software timers
 	OS_InitTCB(); //initializes the 
+	OS_InitMutex(&LCDmutex);
 }
 
 //**********OS_InitTCB************
@@ -152,6 +337,32 @@ void OS_InitTCB(void){
 		FrontOfPriLL[i]=NULL;
 		EndOfPriLL[i]=NULL;
 	}
+	FreeStacks = (struct freeStack*)StackPool;		//the whole pool is one free block
+	FreeStacks->Size = STACKPOOLSIZE;
+	FreeStacks->Next = NULL;
+}
+
+//********OS_ActiveAdd**********
+//put a thread on the active list of its priority, round-robin order
+//except in the EDF class, where the list is kept in deadline order
+//the caller sets its HighestPriority bit, called with interrupts disabled
+static void OS_ActiveAdd(tcbType* thread){
+	uint32_t priority = thread->Priority;
+	if(priority==EDFPRI){
+		EDFLLAdd(&FrontOfPriLL[priority],thread,&EndOfPriLL[priority]);
+	}else{
+		LLAdd(&FrontOfPriLL[priority],thread,&EndOfPriLL[priority]);
+	}
+}
+
+//********OS_Outranks**********
+//1 if thread a should run before thread b, the higher priority, or
+//within the EDF class the earlier deadline
+static int OS_Outranks(tcbType* a, tcbType* b){
+	if(a->Priority != b->Priority){
+		return a->Priority < b->Priority;
+	}
+	return (a->EDF!=NULL)&&((b->EDF==NULL)||((int32_t)(a->EDF->Deadline - b->EDF->Deadline) < 0));
 }
 
 // ******** OS_InitSemaphore ************
@@ -174,44 +385,89 @@ void OS_InitSemaphore(Sema4Type *semaPt, long value){
 // Lab3 block if less than zero
 // input:  pointer to a counting semaphore
 // output: none
+// a free semaphore is taken with one exclusive access update, interrupts
+// are only disabled when the thread may have to block
 void OS_Wait(Sema4Type *semaPt){
 	
 	int32_t status;
 	uint32_t priority;
-	status = StartCritical(); // save I bit 
-	
-#ifdef PROFILER
-	startTime = OS_Time();
-#endif 
+	if(Sema4TryDecrement(&semaPt->Value)){
+		return;
+	}
+	status = StartCritical(); // save BASEPRI
 	
 	semaPt->Value = semaPt->Value - 1;
 	if(semaPt->Value < 0){ // add to sema4's blocking linked list
+		TRACE(THREADBLOCK,RunPt,semaPt);
 		RunPt->BlockedStatus=semaPt;
 		priority = RunPt->Priority;
 		NextThread = RunPt->next;					//Store the next pointer in the proxy thread
 		if(LLRemove(&FrontOfPriLL[priority],RunPt,&EndOfPriLL[priority])) //remove the thread from the active list
 		{	// this was the last thread removed from the list at that priority level
-			LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt); // add thread to end of sema4 blocked LL
-			HighestPriority&=~(1<<(31-priority));		//If it's the last thread at that priority, mark that bin as empty
+			Sem4LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt); // add thread to sema4 blocked LL in priority order
+			HighestPriority&=~(1u<<(31-priority));		//If it's the last thread at that priority, mark that bin as empty
 			EndCritical(status);
 
 			OS_Suspend(JMP2HIGHERPRI); //since the highest priority thread is the last at that priority, re-evaluate highest priority
 		}else{
-			LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt); // add thread to end of sema4 blocked LL
-			EndCritical(status);			//restore I bit, enabling interrupts
+			Sem4LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt); // add thread to sema4 blocked LL in priority order
+			EndCritical(status);			//restore BASEPRI, enabling interrupts
 			OS_Suspend(JMPOVER); // indicate the running thread was blocked, use the ProxyThread
 		}
 	}
-#ifdef PROFILER
-	else
-	{
-		multAccDisTime += OS_TimeDifference(startTime,OS_Time());
-	}
-#endif
 	
 	EndCritical(status);
 }	
 
+// ******** OS_WaitTimeout ************
+// decrement semaphore, block for at most timeout if less than zero
+// the thread is on the semaphore's blocked list and the sleeping list,
+// whichever of OS_Signal and the timeout comes first takes it off the other
+// input:  pointer to a counting semaphore
+//         longest time to block, same units as OS_Sleep, 0 never blocks
+// output: OS_SUCCESS if the semaphore was taken, OS_TIMEOUT if not
+int OS_WaitTimeout(Sema4Type *semaPt, unsigned long timeout){
+	int32_t status;
+	uint32_t priority;
+	if(Sema4TryDecrement(&semaPt->Value)){
+		return OS_SUCCESS;
+	}
+	status = StartCritical();
+	if(semaPt->Value <= 0){
+		if(timeout == 0){
+			EndCritical(status);
+			return OS_TIMEOUT;
+		}
+		semaPt->Value = semaPt->Value - 1;
+		TRACE(THREADBLOCK,RunPt,semaPt);
+		RunPt->BlockedStatus = semaPt;
+		RunPt->TimedOut = 0;
+		OS_SleepCatchUp(OS_Time64());
+		RunPt->SleepCtr = timeout;
+		RunPt->SleepStatus = 1;
+		SlpLLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);
+		priority = RunPt->Priority;
+		NextThread = RunPt->next;
+		if(LLRemove(&FrontOfPriLL[priority],RunPt,&EndOfPriLL[priority])){
+			Sem4LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt);
+			HighestPriority&=~(1u<<(31-priority));
+			EndCritical(status);
+			OS_Suspend(JMP2HIGHERPRI);
+		}else{
+			Sem4LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt);
+			EndCritical(status);
+			OS_Suspend(JMPOVER);
+		}
+		if(RunPt->TimedOut){		// OS_WakeUpSleeping gave the count back
+			return OS_TIMEOUT;
+		}
+		return OS_SUCCESS;
+	}
+	semaPt->Value = semaPt->Value - 1;
+	EndCritical(status);
+	return OS_SUCCESS;
+}
+
 // DA 3/2
 // ******** OS_Signal ************
 // increment semaphore 
@@ -225,36 +481,40 @@ void OS_Signal(Sema4Type *semaPt)
 	tcbType* wakeupThread;
 	int32_t status;
 	
-	status = StartCritical(); // save I bit 
-#ifdef PROFILER
-	startTime = OS_Time();
-#endif
+	if(Sema4TryIncrement(&semaPt->Value)){		// no thread to wake
+		return;
+	}
+	status = StartCritical(); // save BASEPRI
 
 	semaPt->Value = semaPt->Value + 1;
 	if(semaPt->Value <= 0)
 	{		
-		wakeupThread = Sem4LLARemove(semaPt);
+		wakeupThread = Sem4LLARemove(semaPt);		// front of the blocked list is the highest priority waiter
 		if(wakeupThread==NULL){
 			EndCritical(status);
 			return;
 		}
+		if(wakeupThread->SleepStatus){		// timed wait, the timeout no longer applies
+			SlpLLRemove(&FrontOfSlpLL,wakeupThread,&EndOfSlpLL);
+			wakeupThread->SleepStatus = 0;
+			wakeupThread->SleepCtr = 0;
+		}
 		// add to the priority linked list for that priority level of wakeupThread.
-		LLRemove(&semaPt->FrontPt,wakeupThread,&semaPt->EndPt);
-		LLAdd(&FrontOfPriLL[wakeupThread->Priority],wakeupThread,&EndOfPriLL[wakeupThread->Priority]);
+		OS_ActiveAdd(wakeupThread);
 		wakeupThread->BlockedStatus = NULL;
-		if(wakeupThread->Priority < RunPt->Priority) // if awoken thread is higher priority than current thread, switch to it.
+		TRACE(THREADUNBLOCK,wakeupThread,semaPt);
+		HighestPriority |= (1u<<(31-wakeupThread->Priority));
+		if(OS_Outranks(wakeupThread,RunPt)) // if awoken thread is higher priority than current thread, switch to it.
 		{
-			HighestPriority |= (1<<(31-wakeupThread->Priority));
 			EndCritical(status);
 			OS_Suspend(JMP2HIGHERPRI);
+		}else if(ProxyChange && OS_Outranks(wakeupThread,ProxyThread)){
+			// an ISR woke it after RunPt blocked but before PendSV ran, don't let PendSV switch to a lower priority thread
+			ProxyThread = wakeupThread;
+		}else if(g_Stretched){		// tickless, RunPt may now have a thread to round-robin with
+			OS_ResetSysTick();
 		}
 	}
-#ifdef PROFILER
-	else
-	{
-		multAccDisTime += OS_TimeDifference(startTime,OS_Time());
-	}
-#endif
 	EndCritical(status);
 }	
 
@@ -348,50 +608,419 @@ void OS_bSignal(Sema4Type *semaPt)
 #endif
 }
 
-//******** OS_AddThread *************** 
-// add a foregound thread to the scheduler
-// Inputs: pointer to a void/void foreground task
+//********OS_ChangePriority**********
+//Moves a thread to a new priority, keeping whatever list it is on in order
+//A ready thread is requeued at the back of its new priority bin, a blocked
+//thread is reinserted into its semaphore's blocked list, and a sleeping
+//thread just picks up the new priority when it wakes up
+//Called with interrupts disabled
+static void OS_ChangePriority(tcbType* thread, int32_t priority){
+	Sema4Type* semaPt;
+	int32_t oldPriority;
+	oldPriority = thread->Priority;
+	if(oldPriority==priority){
+		return;
+	}
+	semaPt = thread->BlockedStatus;
+	if(semaPt!=NULL){
+		LLRemove(&semaPt->FrontPt,thread,&semaPt->EndPt);
+		thread->Priority = priority;
+		Sem4LLAdd(&semaPt->FrontPt,thread,&semaPt->EndPt);
+	}else if(thread->SleepStatus){
+		thread->Priority = priority;
+	}else{
+		if(LLRemove(&FrontOfPriLL[oldPriority],thread,&EndOfPriLL[oldPriority])){
+			HighestPriority&=~(1u<<(31-oldPriority));		//that was the last thread at the old priority
+		}
+		thread->Priority = priority;
+		OS_ActiveAdd(thread);
+		HighestPriority|=1u<<(31-priority);
+	}
+}
+
+// ******** OS_InitMutex ************
+// initialize a priority inheritance mutex to free
+// input:  pointer to a mutex
+// output: none
+void OS_InitMutex(MutexType *mutexPt){
+	int32_t status;
+	status = StartCritical();
+	OS_InitSemaphore(&mutexPt->Sema4,1);
+	mutexPt->Owner = NULL;
+	mutexPt->NextHeld = NULL;
+	mutexPt->MaxBlockTime = 0;
+	EndCritical(status);
+}
+
+//********OS_MutexPriority**********
+//priority a thread should run at, the one it was created at raised to that
+//of the highest priority thread waiting on any mutex it still holds
+//called with interrupts disabled
+static int32_t OS_MutexPriority(tcbType* thread){
+	MutexType* held;
+	int32_t priority = thread->BasePriority;
+	for(held=thread->Held; held!=NULL; held=held->NextHeld){
+		if((held->Sema4.FrontPt!=NULL)&&(held->Sema4.FrontPt->Priority < priority)){		//blocked list is in priority order
+			priority = held->Sema4.FrontPt->Priority;
+		}
+	}
+	return priority;
+}
+
+// ******** OS_MutexLock ************
+// take the mutex, block if another thread owns it
+// If the caller is higher priority than the owner, the owner is moved up to
+// the caller's priority bin so mid priority threads can't hold it off
+// Records the longest time a thread had to wait in MaxBlockTime
+// input:  pointer to a mutex
+// output: none
+void OS_MutexLock(MutexType *mutexPt){
+	int32_t status;
+	unsigned long start, blockTime;
+	status = StartCritical();
+	if(mutexPt->Owner==NULL){		//free, take it without blocking
+		mutexPt->Sema4.Value = mutexPt->Sema4.Value - 1;
+		mutexPt->Owner = RunPt;
+		mutexPt->NextHeld = RunPt->Held;
+		RunPt->Held = mutexPt;
+		EndCritical(status);
+		return;
+	}
+	if(RunPt->Priority < mutexPt->Owner->Priority){		//priority inheritance
+		OS_ChangePriority(mutexPt->Owner,RunPt->Priority);
+	}
+	start = OS_Time();
+	mutexPt->Sema4.Value = mutexPt->Sema4.Value - 1;		//owned, so this goes negative
+	TRACE(THREADBLOCK,RunPt,&mutexPt->Sema4);
+	RunPt->BlockedStatus = &mutexPt->Sema4;
+	OS_BlockRunning(status,OS_FOREVER,&mutexPt->Sema4);		//blocks before the owner can unlock
+	status = StartCritical();		//OS_MutexUnlock made us the owner before waking us up
+	blockTime = OS_TimeDifference(start,OS_Time());
+	if(blockTime > mutexPt->MaxBlockTime){
+		mutexPt->MaxBlockTime = blockTime;
+	}
+	EndCritical(status);
+}
+
+// ******** OS_MutexUnlock ************
+// give the mutex to the highest priority waiting thread, or free it
+// the caller drops to its own priority, or to what the waiters on the
+// mutexes it still holds lend it, so unlocking in any order is fine
+// input:  pointer to a mutex owned by the caller
+// output: none
+void OS_MutexUnlock(MutexType *mutexPt){
+	int32_t status;
+	int32_t priority;
+	MutexType** link;
+	status = StartCritical();
+	for(link=&RunPt->Held; (*link!=NULL)&&(*link!=mutexPt); link=&(*link)->NextHeld){
+	}
+	if(*link!=NULL){
+		*link = mutexPt->NextHeld;
+	}
+	if(mutexPt->Sema4.FrontPt!=NULL){		//front of the blocked list is the thread OS_Signal wakes
+		mutexPt->Owner = mutexPt->Sema4.FrontPt;
+		mutexPt->NextHeld = mutexPt->Owner->Held;
+		mutexPt->Owner->Held = mutexPt;
+	}else{
+		mutexPt->Owner = NULL;
+	}
+	OS_Signal(&mutexPt->Sema4);		//any switch waits until interrupts are enabled again
+	priority = OS_MutexPriority(RunPt);
+	if(RunPt->Priority!=priority){	//give back the inherited priority
+		OS_ChangePriority(RunPt,priority);
+		OS_Suspend(JMP2HIGHERPRI);
+	}
+	EndCritical(status);
+}
+
+//********OS_EDFArm**********
+//start the release timer for the earliest release of a waiting EDF thread
+//called with interrupts disabled
+//input: OS_TimerNow value of now
+static void OS_EDFArm(uint32_t now){
+	OSEdfType* next = NULL;
+	uint32_t k;
+	int32_t delay;
+	for(k=0; k<g_NumEDF; k++){
+		if(EDFs[k].Waiting && ((next==NULL)||((int32_t)(EDFs[k].Release - next->Release) < 0))){
+			next = &EDFs[k];
+		}
+	}
+	if(next==NULL){
+		OS_TimerStop(g_EDFTimer);
+		return;
+	}
+	delay = (int32_t)(next->Release - now);
+	g_EDFTimer->Period = (delay > 0) ? delay : 1;
+	OS_TimerStart(g_EDFTimer);
+}
+
+//********OS_EDFRelease**********
+//release timer callback, makes every EDF thread whose release time has
+//come ready with its new deadline, preempts at most once
+static void OS_EDFRelease(void){
+	OSEdfType* edf;
+	tcbType* highest = NULL;
+	uint32_t now, k;
+	int32_t status;
+	status = StartCritical();
+	now = OS_TimerNow();
+	for(k=0; k<g_NumEDF; k++){
+		edf = &EDFs[k];
+		if(edf->Waiting && ((int32_t)(edf->Release - now) <= 0)){
+			edf->Waiting = 0;
+			edf->Deadline = edf->Release + edf->RelDeadline;		// before OS_Ready sorts it in
+			TRACE(THREADUNBLOCK,edf->Thread,edf);
+			OS_Ready(edf->Thread);
+			if((highest==NULL)||OS_Outranks(edf->Thread,highest)){
+				highest = edf->Thread;
+			}
+		}
+	}
+	OS_EDFArm(now);
+	if(highest!=NULL){
+		OS_Preempt(highest,status);
+		return;
+	}
+	EndCritical(status);
+}
+
+//********OS_EDFRequeue**********
+//move RunPt to its place in the EDF active list after its deadline
+//changed, switch away if it is no longer due first
+//called with interrupts disabled, enables them
+static void OS_EDFRequeue(int32_t status){
+	LLRemove(&FrontOfPriLL[EDFPRI],RunPt,&EndOfPriLL[EDFPRI]);
+	OS_ActiveAdd(RunPt);
+	if(FrontOfPriLL[EDFPRI]!=RunPt){
+		EndCritical(status);
+		OS_Suspend(JMP2HIGHERPRI);
+		return;
+	}
+	EndCritical(status);
+}
+
+//********OS_EDFJobDone**********
+//account for the job RunPt just completed and wait for its next release
+static void OS_EDFJobDone(OSEdfType* edf){
+	uint32_t now, response;
+	int32_t status;
+	status = StartCritical();
+	now = OS_TimerNow();
+	response = now - edf->Release;
+	if(response > edf->MaxResponse){
+		edf->MaxResponse = response;
+	}
+	edf->Jobs++;
+	if((int32_t)(now - edf->Deadline) > 0){
+		edf->Misses++;
+	}
+	edf->Release += edf->Period;
+	while((int32_t)(now - (edf->Release + edf->Period)) >= 0){		// a whole period late, skip the releases it missed
+		edf->Release += edf->Period;
+		edf->Misses++;
+	}
+	if((int32_t)(edf->Release - now) <= 0){		// the next job is already due
+		edf->Deadline = edf->Release + edf->RelDeadline;
+		OS_EDFRequeue(status);
+		return;
+	}
+	edf->Waiting = 1;
+	TRACE(THREADBLOCK,RunPt,edf);
+	OS_EDFArm(now);
+	OS_BlockRunning(status,OS_FOREVER,NULL);
+}
+
+//********OS_EDFThread**********
+//body of every EDF thread, finds the EDF slot OS_AddEDFThread bound it to,
+//releases its first job and runs one job per period
+//EDF threads first run in any order, so the slot is looked up by RunPt
+static void OS_EDFThread(void){
+	OSEdfType* edf = NULL;
+	uint32_t k;
+	int32_t status;
+	status = StartCritical();
+	for(k=0; k<g_NumEDF; k++){
+		if(EDFs[k].Thread==RunPt){
+			edf = &EDFs[k];
+			break;
+		}
+	}
+	if(edf==NULL){
+		EndCritical(status);
+		OS_Kill();
+	}
+	edf->Release = OS_TimerNow();
+	edf->Deadline = edf->Release + edf->RelDeadline;
+	RunPt->EDF = edf;
+	OS_EDFRequeue(status);
+	while(1){
+		edf->Task();
+		OS_EDFJobDone(edf);
+	}
+}
+
+//******** OS_AddEDFThread *************** 
+// add a periodic thread to the earliest deadline first class
+// Inputs: job, a void/void function run to completion once per period,
+//           it may block but not kill itself
 //         number of bytes allocated for its stack
-//         priority, 0 is highest, 5 is the lowest
-// Outputs: 1 if successful, 0 if this thread can not be added
-// stack size must be divisable by 8 (aligned to double word boundary)
-// In Lab 2, you can ignore both the stackSize and priority fields
-// In Lab 3, you can ignore the stackSize fields
+//         period in us, 1 to 26000000
+//         relative deadline in us, 1 to period
+// Outputs: 1 if successful, 0 if all NUMEDF are in use, the times are out
+//          of range or the thread can not be added
+// EDF threads all sit in priority bin EDFPRI, kept in deadline order by
+// OS_ActiveAdd, so HighestPri and PendSV pick the earliest deadline
+// without knowing about the class
+int OS_AddEDFThread(void(*task)(void), unsigned long stackSize,
+	unsigned long period_us, unsigned long deadline_us){
+	OSEdfType* edf;
+	int32_t status;
+	if((task==NULL)||(period_us==0)||(period_us>MAXTIMERUS)||(deadline_us==0)||(deadline_us>period_us)){
+		return 0;
+	}
+	status = StartCritical();
+	if(g_NumEDF>=NUMEDF){
+		EndCritical(status);
+		return 0;
+	}
+	if(g_EDFTimer==NULL){
+		g_EDFTimer = OS_TimerCreate(&OS_EDFRelease,period_us,1);
+		if(g_EDFTimer==NULL){
+			EndCritical(status);
+			return 0;
+		}
+		OS_TimerStop(g_EDFTimer);
+	}
+	edf = &EDFs[g_NumEDF];
+	edf->Task = task;
+	edf->Thread = NULL;
+	edf->Period = period_us*CYCLESPERUS;
+	edf->RelDeadline = deadline_us*CYCLESPERUS;
+	edf->Waiting = 0;
+	edf->Jobs = 0;
+	edf->Misses = 0;
+	edf->MaxResponse = 0;
+	edf->Thread = OS_NewThread(&OS_EDFThread,stackSize,EDFPRI);		// this slot's job and stack go together
+	if(edf->Thread==NULL){
+		EndCritical(status);
+		return 0;
+	}
+	g_NumEDF++;		// the thread cannot run before this, interrupts are disabled
+	EndCritical(status);
+	return 1;
+}
+
+//******** OS_EDFReport *************** 
+// print period, deadline, jobs, deadline misses and the longest response
+// time of every EDF thread
+// Inputs: none
+// Outputs: none
+void OS_EDFReport(void){
+	uint32_t k;
+	printf("EDF\tPeriod(us)\tDeadline(us)\tJobs\tMisses\tMaxResp(us)\n\r");
+	for(k=0; k<g_NumEDF; k++){
+		printf("%d\t%u\t\t%u\t\t%u\t%u\t%u\n\r",(EDFs[k].Thread==NULL) ? -1 : EDFs[k].Thread->ID,
+			EDFs[k].Period/CYCLESPERUS,EDFs[k].RelDeadline/CYCLESPERUS,EDFs[k].Jobs,EDFs[k].Misses,
+			EDFs[k].MaxResponse/CYCLESPERUS);
+	}
+}
+
+//********OS_NewThread**********
+//Creates a thread at any priority, EDFPRI included
+//Inputs: pointer to a void/void foreground task
+//        number of bytes allocated for its stack
+//        priority
+//Outputs: the new thread's TCB, NULL if this thread can not be added
+//stack size is rounded up to a multiple of 8 bytes (aligned to double word boundary)
+//and to at least MINSTACKSIZE words, it is carved out of StackPool
 uint32_t g_NumAliveThreads=0;
-int OS_AddThread(void(*task)(void), 
+static tcbType* OS_NewThread(void(*task)(void), 
   unsigned long stackSize, unsigned long priority){ 
 	uint32_t k=0;
+	uint32_t words;
+	int32_t* stack;
 
 	long status = StartCritical();
+	OS_ReclaimKilled();
+	words = ((stackSize+7)/8)*2;
+	if(words<MINSTACKSIZE){
+		words = MINSTACKSIZE;
+	}
 	if(g_NumAliveThreads>=NUMTHREADS){
 		EndCritical(status);
-		return 0;
+		return NULL;
 	} //If max threads have been added return failure
 	for(k=0; k<NUMTHREADS; k++){									//for loop checks for free space in array of tcbs
 		if(tcbs[k].MemStatus==FREE){
+			stack = OS_StackAlloc(&words);
+			if(stack==NULL){
+				break;			//stack pool is full
+			}
 			//update thread information
 			tcbs[k].ID=k;				
 			tcbs[k].Priority=priority;
 			tcbs[k].SleepCtr=0;
+			tcbs[k].SleepStatus=0;
+			tcbs[k].BlockedStatus=NULL;
+			tcbs[k].TimedOut=0;
+			tcbs[k].StackBase=stack;
+			tcbs[k].StackSize=words;
+			tcbs[k].RunTime=0;
+			tcbs[k].LastRun=OS_Time();
+			tcbs[k].SwitchCount=0;
+			tcbs[k].NotifyValue=0;
+			tcbs[k].NotifyWaiting=0;
+			tcbs[k].BasePriority=priority;
+			tcbs[k].Held=NULL;
 			//Set the stacks
 			SetInitialStack(k);
-			Stacks[k][stackSize-2] = (int32_t)(task); // PC
+			stack[words-2] = (int32_t)(task); // PC
+#ifdef HOSTSIM
+			Sim_ThreadInit(&tcbs[k],task);		// host build runs the thread on a ucontext
+#endif
 			if(g_NumAliveThreads==0){
-				HighestPriority|=1<<(31-priority);		//set the highest priority bit 
+				HighestPriority|=1u<<(31-priority);		//set the highest priority bit 
 			} 
 			g_NumAliveThreads++;
 			tcbs[k].MemStatus=USED;	//Set memory as used
-			LLAdd(&FrontOfPriLL[priority],&tcbs[k],&EndOfPriLL[priority]);		//Add tcb to linked list
-			if(1<<(31-priority) > HighestPriority){
+			tcbs[k].EDF=NULL;			//an EDF thread moves into the EDF class when it first runs
+			OS_ActiveAdd(&tcbs[k]);		//Add tcb to linked list
+			if(1u<<(31-priority) > HighestPriority){
 				ProxyChange = 1;
 				ProxyThread = FrontOfPriLL[priority];
 			}
-			HighestPriority|=1<<(31-priority);		//set the highest priority bit 
-			break;
+			HighestPriority|=1u<<(31-priority);		//set the highest priority bit 
+			if(g_Stretched){			//tickless, don't make the new thread wait for a stretched SysTick
+				OS_ResetSysTick();
+			}
+			EndCritical(status);
+			return &tcbs[k];        // successful;
 		}
 	}
 	EndCritical(status);
-  return 1;               // successful;
+  return NULL;            // no TCB or no room in the stack pool
+}
+
+//******** OS_AddThread *************** 
+// add a foregound thread to the scheduler
+// Inputs: pointer to a void/void foreground task
+//         number of bytes allocated for its stack
+//         priority, 1 is highest, 5 is the lowest, 0 is EDFPRI and is
+//           rejected, every thread in that bin runs behind the EDF jobs,
+//           use OS_AddEDFThread
+// Outputs: 1 if successful, 0 if this thread can not be added
+// stack size is rounded up to a multiple of 8 bytes (aligned to double word boundary)
+// and to at least MINSTACKSIZE words, it is carved out of StackPool
+// a thread that uses floating point needs 136 more bytes for the FPU
+// registers PendSV_Handler and the exception frame save
+int OS_AddThread(void(*task)(void), 
+  unsigned long stackSize, unsigned long priority){ 
+	if(priority==EDFPRI){
+		return 0;
+	}
+	return OS_NewThread(task,stackSize,priority)!=NULL;
 }
 
 //******** OS_Id *************** 
@@ -402,6 +1031,263 @@ unsigned long OS_Id(void){
 	return RunPt->ID;
 }
 
+//******** OS_Self *************** 
+// returns the TCB of the currently running thread
+// Inputs: none
+// Outputs: TCB of the running thread
+tcbType* OS_Self(void){
+	return RunPt;
+}
+
+//********OS_BlockRunning**********
+//take RunPt off the active list and switch away, it is put on the sleeping
+//list too unless timeout is OS_FOREVER, the caller has already recorded
+//what it waits for, called with interrupts disabled, enables them
+//input: status from StartCritical, timeout in ms,
+//       blocked list to wait on in priority order, NULL for none
+static void OS_BlockRunning(int32_t status, unsigned long timeout, Sema4Type* semaPt){
+	uint32_t priority;
+	int empty;
+	if(timeout != OS_FOREVER){
+		OS_SleepCatchUp(OS_Time64());
+		RunPt->SleepCtr = timeout;
+		RunPt->SleepStatus = 1;
+		SlpLLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);
+	}
+	priority = RunPt->Priority;
+	NextThread = RunPt->next;
+	empty = LLRemove(&FrontOfPriLL[priority],RunPt,&EndOfPriLL[priority]);
+	if(semaPt!=NULL){		// the links are free now that it is off the active list
+		Sem4LLAdd(&semaPt->FrontPt,RunPt,&semaPt->EndPt);
+	}
+	if(empty){
+		HighestPriority&=~(1u<<(31-priority));
+		EndCritical(status);
+		OS_Suspend(JMP2HIGHERPRI);
+	}else{
+		EndCritical(status);
+		OS_Suspend(JMPOVER);
+	}
+}
+
+//********OS_Ready**********
+//put a blocked thread back on the active list, taking it off the sleeping
+//list if its wait had a timeout, called with interrupts disabled
+//input: thread
+static void OS_Ready(tcbType* thread){
+	if(thread->SleepStatus){		// the timeout no longer applies
+		SlpLLRemove(&FrontOfSlpLL,thread,&EndOfSlpLL);
+		thread->SleepStatus = 0;
+		thread->SleepCtr = 0;
+	}
+	OS_ActiveAdd(thread);
+	HighestPriority |= (1u<<(31-thread->Priority));
+}
+
+//********OS_Preempt**********
+//switch to the highest priority thread that OS_Ready woke if it beats RunPt
+//called with interrupts disabled, enables them
+//input: thread of the highest priority that was woken, status from StartCritical
+static void OS_Preempt(tcbType* thread, int32_t status){
+	if(OS_Outranks(thread,RunPt)){
+		EndCritical(status);
+		OS_Suspend(JMP2HIGHERPRI);
+		return;
+	}
+	if(ProxyChange && OS_Outranks(thread,ProxyThread)){
+		ProxyThread = thread;		// woken after RunPt blocked but before PendSV ran
+	}else if(g_Stretched){		// tickless, RunPt may now have a thread to round-robin with
+		OS_ResetSysTick();
+	}
+	EndCritical(status);
+}
+
+//********OS_MakeReady**********
+//OS_Ready one thread and preempt RunPt if it is higher priority
+//called with interrupts disabled, enables them
+//input: thread, status from StartCritical
+static void OS_MakeReady(tcbType* thread, int32_t status){
+	OS_Ready(thread);
+	OS_Preempt(thread,status);
+}
+
+//******** OS_NotifyGive *************** 
+// add one to a thread's notification value and wake it if it is in
+// OS_NotifyTake, may be called by an ISR
+// Inputs: thread to notify, from OS_Self
+// Outputs: none
+void OS_NotifyGive(tcbType* thread){
+	int32_t status;
+	status = StartCritical();
+	thread->NotifyValue++;
+	if(thread->NotifyWaiting){
+		thread->NotifyWaiting = 0;
+		TRACE(THREADUNBLOCK,thread,0);
+		OS_MakeReady(thread,status);
+		return;
+	}
+	EndCritical(status);
+}
+
+//******** OS_NotifySetBits *************** 
+// OR bits into a thread's notification value and wake it if it is in
+// OS_NotifyTake, may be called by an ISR
+// Inputs: thread to notify, bits to set
+// Outputs: none
+void OS_NotifySetBits(tcbType* thread, uint32_t mask){
+	int32_t status;
+	status = StartCritical();
+	thread->NotifyValue |= mask;
+	if(thread->NotifyWaiting && thread->NotifyValue){
+		thread->NotifyWaiting = 0;
+		TRACE(THREADUNBLOCK,thread,0);
+		OS_MakeReady(thread,status);
+		return;
+	}
+	EndCritical(status);
+}
+
+//******** OS_NotifyTake *************** 
+// wait until the running thread's notification value is not zero,
+// then return it and clear it
+// Inputs: timeout in ms, 0 never blocks, OS_FOREVER never times out
+// Outputs: the count or bits received, 0 if the timeout ran out first
+// The value lives in the TCB, there is no wait list to keep in order
+uint32_t OS_NotifyTake(unsigned long timeout){
+	uint32_t value;
+	int32_t status;
+	status = StartCritical();
+	if((RunPt->NotifyValue==0) && (timeout!=0)){
+		TRACE(THREADBLOCK,RunPt,0);
+		RunPt->NotifyWaiting = 1;
+		OS_BlockRunning(status,timeout,NULL);
+		status = StartCritical();		// woken by a notification or the timeout
+	}
+	value = RunPt->NotifyValue;
+	RunPt->NotifyValue = 0;
+	EndCritical(status);
+	return value;
+}
+
+// ******** OS_InitEventGroup ************
+// initialize an event group with every bit clear and no waiters
+// input:  pointer to an event group
+// output: none
+void OS_InitEventGroup(OSEventGroupType *groupPt){
+	int32_t status;
+	status = StartCritical();
+	OS_InitSemaphore(&groupPt->Waiters,0);
+	groupPt->Bits = 0;
+	EndCritical(status);
+}
+
+//********OS_EventSatisfied**********
+//1 if the bits meet what a waiter asked OS_EventWait for
+static int OS_EventSatisfied(uint32_t bits, uint32_t mask, uint32_t options){
+	if(options&OS_EVENT_ALL){
+		return (bits&mask)==mask;
+	}
+	return (bits&mask)!=0;
+}
+
+// ******** OS_EventSet ************
+// set bits in an event group and wake every waiter they satisfy,
+// may be called by an ISR
+// input:  pointer to an event group, bits to set
+// output: none
+// all the waiters are checked in one pass over the blocked list, bits
+// the woken threads asked to clear are cleared after the pass so every
+// waiter sees the same bits
+void OS_EventSet(OSEventGroupType *groupPt, uint32_t mask){
+	tcbType* thread;
+	tcbType* nextThread;
+	tcbType* highest = NULL;
+	uint32_t clear = 0;
+	int32_t n;
+	int32_t status;
+	status = StartCritical();
+	groupPt->Bits |= mask;
+	thread = groupPt->Waiters.FrontPt;
+	for(n = -groupPt->Waiters.Value; n > 0; n--){		// Value is minus the number of waiters
+		nextThread = thread->next;
+		if(OS_EventSatisfied(groupPt->Bits,thread->EventMask,thread->EventOptions)){
+			LLRemove(&groupPt->Waiters.FrontPt,thread,&groupPt->Waiters.EndPt);
+			groupPt->Waiters.Value++;
+			thread->BlockedStatus = NULL;
+			thread->EventBits = groupPt->Bits;
+			if(thread->EventOptions&OS_EVENT_CLEAR){
+				clear |= thread->EventMask;
+			}
+			TRACE(THREADUNBLOCK,thread,groupPt);
+			OS_Ready(thread);
+			if(highest==NULL){
+				highest = thread;		// the blocked list is in priority order
+			}
+		}
+		thread = nextThread;
+	}
+	groupPt->Bits &= ~clear;
+	if(highest!=NULL){
+		OS_Preempt(highest,status);
+		return;
+	}
+	EndCritical(status);
+}
+
+// ******** OS_EventClear ************
+// clear bits in an event group, may be called by an ISR
+// input:  pointer to an event group, bits to clear
+// output: none
+void OS_EventClear(OSEventGroupType *groupPt, uint32_t mask){
+	int32_t status;
+	status = StartCritical();
+	groupPt->Bits &= ~mask;
+	EndCritical(status);
+}
+
+// ******** OS_EventGet ************
+// input:  pointer to an event group
+// output: the bits that are set now
+uint32_t OS_EventGet(OSEventGroupType *groupPt){
+	return groupPt->Bits;
+}
+
+// ******** OS_EventWait ************
+// block until bits of an event group are set, any of them or all of them
+// input:  pointer to an event group, bits to wait for,
+//         OS_EVENT_ALL to wait for all of them instead of any,
+//         OS_EVENT_CLEAR to clear them when the wait is satisfied,
+//         timeout in ms, 0 never blocks, OS_FOREVER never times out
+// output: the group's bits when the wait was satisfied, 0 if the timeout ran out
+// the thread waits on the group's blocked list through BlockedStatus, so a
+// timeout takes it off the list the same way as for OS_WaitTimeout
+uint32_t OS_EventWait(OSEventGroupType *groupPt, uint32_t mask, uint32_t options, unsigned long timeout){
+	uint32_t bits;
+	int32_t status;
+	status = StartCritical();
+	bits = groupPt->Bits;
+	if(OS_EventSatisfied(bits,mask,options)){
+		if(options&OS_EVENT_CLEAR){
+			groupPt->Bits &= ~mask;
+		}
+		EndCritical(status);
+		return bits;
+	}
+	if(timeout==0){
+		EndCritical(status);
+		return 0;
+	}
+	TRACE(THREADBLOCK,RunPt,groupPt);
+	RunPt->EventMask = mask;
+	RunPt->EventOptions = options;
+	RunPt->EventBits = 0;		// stays 0 if the timeout runs out
+	RunPt->TimedOut = 0;
+	RunPt->BlockedStatus = &groupPt->Waiters;
+	groupPt->Waiters.Value--;
+	OS_BlockRunning(status,timeout,&groupPt->Waiters);
+	return RunPt->EventBits;
+}
+
 
 void OS_LaunchThread(void(*taskPtr)(void), int timer);
 // initializes a new thread with given period and priority
@@ -426,6 +1312,533 @@ int OS_AddPeriodicThread(void(*task)(void), int timer, unsigned long period, uns
 	return 0;
 }
 
+//********OS_LoadFind**********
+//load with this exception number, NULL if there is none
+static OSLoadType* OS_LoadFind(uint32_t vector){
+	uint32_t k;
+	for(k=0; k<g_NumLoads; k++){
+		if(Loads[k].Vector==vector){
+			return &Loads[k];
+		}
+	}
+	return NULL;
+}
+
+//********OS_LoadWcet**********
+//execution time the analysis assumes, the larger of declared and measured
+static uint32_t OS_LoadWcet(OSLoadType* load){
+	return (load->Measured > load->Wcet) ? load->Measured : load->Wcet;
+}
+
+//********OS_RtaResponse**********
+//worst case response time of load k, the least fixed point of
+//R = C(k) + sum over the other loads j at the same or a higher priority of ceil(R/T(j))*C(j)
+//equal priorities do not preempt but one can be pending ahead of k, so they count as interference
+//Outputs: bus cycles, stops as soon as it passes the period of k
+static uint32_t OS_RtaResponse(uint32_t k){
+	uint64_t response, next;
+	uint32_t j;
+	next = OS_LoadWcet(&Loads[k]);
+	do{
+		response = next;
+		next = OS_LoadWcet(&Loads[k]);
+		for(j=0; j<g_NumLoads; j++){
+			if((j!=k)&&(Loads[j].Priority<=Loads[k].Priority)){
+				next += ((response+Loads[j].Period-1)/Loads[j].Period)*OS_LoadWcet(&Loads[j]);
+			}
+		}
+		if(next > Loads[k].Period){
+			return (next > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)next;
+		}
+	}while(next != response);
+	return (uint32_t)response;
+}
+
+//********OS_RtaAdmit**********
+//keep the load just added as Loads[g_NumLoads-1] if every load still
+//meets its period, otherwise drop it and print which one would miss
+//Outputs: 1 if kept, 0 if dropped
+static int OS_RtaAdmit(void){
+	uint32_t k, response = 0;
+	int32_t status;
+	status = StartCritical();
+	for(k=0; k<g_NumLoads; k++){
+		response = OS_RtaResponse(k);
+		if(response > Loads[k].Period){
+			break;
+		}
+	}
+	if(k==g_NumLoads){
+		EndCritical(status);
+		return 1;
+	}
+	g_NumLoads--;
+	EndCritical(status);
+	printf("RTA: rejected vector %u, vector %u would respond in %u us, period %u us\n\r",
+		Loads[g_NumLoads].Vector,Loads[k].Vector,response/CYCLESPERUS,Loads[k].Period/CYCLESPERUS);
+	return 0;
+}
+
+//********OS_LoadAdd**********
+//fill in the next load, NULL if the table is full or the vector is taken
+static OSLoadType* OS_LoadAdd(uint32_t vector, uint32_t period, uint32_t wcet_us, uint32_t priority){
+	OSLoadType* load;
+	int32_t status;
+	status = StartCritical();
+	if((g_NumLoads>=NUMLOADS)||(OS_LoadFind(vector)!=NULL)){
+		EndCritical(status);
+		printf("RTA: rejected vector %u, already known or all %d loads in use\n\r",vector,NUMLOADS);
+		return NULL;
+	}
+	load = &Loads[g_NumLoads++];
+	load->Task = NULL;
+	load->Vector = vector;
+	load->Priority = priority;
+	load->Period = period;
+	load->Wcet = wcet_us*CYCLESPERUS;
+	load->Measured = 0;
+	load->Runs = 0;
+	EndCritical(status);
+	return load;
+}
+
+//********OS_AdmittedTask**********
+//what the timer interrupt of an admitted periodic thread runs,
+//finds the task by the active exception number and measures it
+static void OS_AdmittedTask(void){
+	OSLoadType* load = OS_LoadFind(NVIC_INT_CTRL_R&NVIC_INT_CTRL_VEC_ACT_M);
+	OS_ISREnter();
+	load->Task();
+	OS_ISRExit();
+}
+
+//******** OS_AdmitPeriodicThread *************** 
+// add a background periodic task if the response time analysis shows every
+// periodic interrupt load, this one included, still finishes within its period
+// Inputs: pointer to a void/void background function, same rules as OS_AddPeriodicThread
+//         timer 0,1 or 4 to 9 (Timer0A to Timer4B, Timer1 is the OS clock)
+//         period in us, 13 to 1000000
+//         worst case execution time in us
+//         NVIC priority OS_KERNELPRI to 6, 0 is the highest
+// Outputs: 1 if admitted and started, 0 if rejected, the reason is printed
+// OS_AddPeriodicThread takes a frequency, so the period analysed is the one
+// the timer really gets, 80000000/(1000000/period_us) bus cycles
+int OS_AdmitPeriodicThread(void(*task)(void), int timer, unsigned long period_us,
+	unsigned long wcet_us, unsigned long priority){
+	OSLoadType* load;
+	unsigned long frequency;
+	if((task==NULL)||(timer<0)||(timer>9)||(timer==2)||(timer==3)||
+		(period_us<13)||(period_us>1000000)||(wcet_us==0)||(priority<OS_KERNELPRI)||(priority>6)){
+		printf("RTA: rejected timer %d, out of range\n\r",timer);
+		return 0;
+	}
+	frequency = 1000000/period_us;
+	load = OS_LoadAdd(TimerVector[timer],CLOCKSPEED_80MHZ/frequency,wcet_us,priority);
+	if(load==NULL){
+		return 0;
+	}
+	load->Task = task;
+	if(OS_RtaAdmit()==0){
+		return 0;
+	}
+	OS_AddPeriodicThread(&OS_AdmittedTask,timer,frequency,priority);
+	return 1;
+}
+
+//******** OS_AddISRLoad *************** 
+// tell the response time analysis about an interrupt that is not a periodic
+// thread, like the ADC, UART or software timers
+// Inputs: exception number (interrupt number + 16)
+//         shortest time between two interrupts in us
+//         worst case execution time in us
+//         its NVIC priority, 0 is the highest
+// Outputs: 1 if the periodic loads stay schedulable, 0 if rejected, the
+//          reason is printed and the load is not recorded
+int OS_AddISRLoad(unsigned long vector, unsigned long period_us,
+	unsigned long wcet_us, unsigned long priority){
+	if((vector<16)||(vector>154)||(period_us==0)||(period_us>MAXTIMERUS)||(priority>7)){
+		printf("RTA: rejected vector %lu, out of range\n\r",vector);
+		return 0;
+	}
+	if(OS_LoadAdd(vector,period_us*CYCLESPERUS,wcet_us,priority)==NULL){
+		return 0;
+	}
+	return OS_RtaAdmit();
+}
+
+//******** OS_ISREnter *************** 
+// start measuring the execution time of the interrupt handler that is running
+// Inputs: none
+// Outputs: none
+void OS_ISREnter(void){
+	int32_t status;
+	status = StartCritical();
+	if(g_ISRDepth < ISRNEST){
+		g_ISRStart[g_ISRDepth] = OS_TimerNow();
+		g_ISRBefore[g_ISRDepth] = g_ISRCycles;
+	}
+	g_ISRDepth++;
+	EndCritical(status);
+}
+
+//******** OS_ISRExit *************** 
+// stop measuring, the time less any nested interrupts is the handler's
+// measured execution time if it is longer than any seen before
+// Inputs: none
+// Outputs: none
+void OS_ISRExit(void){
+	OSLoadType* load;
+	uint32_t span, run;
+	int32_t status;
+	status = StartCritical();
+	g_ISRDepth--;
+	if(g_ISRDepth < ISRNEST){
+		span = OS_TimerNow() - g_ISRStart[g_ISRDepth];
+		run = span - (g_ISRCycles - g_ISRBefore[g_ISRDepth]);		// less the handlers that preempted this one
+		g_ISRCycles = g_ISRBefore[g_ISRDepth] + span;
+		load = OS_LoadFind(NVIC_INT_CTRL_R&NVIC_INT_CTRL_VEC_ACT_M);
+		if(load!=NULL){
+			load->Runs++;
+			if(run > load->Measured){
+				load->Measured = run;
+			}
+		}
+	}
+	EndCritical(status);
+}
+
+//******** OS_RtaHeadroom *************** 
+// CPU time the periodic interrupt loads leave for threads
+// Inputs: none
+// Outputs: tenths of a percent, 0 if they need all of it
+unsigned long OS_RtaHeadroom(void){
+	uint64_t used = 0;
+	uint32_t k;
+	for(k=0; k<g_NumLoads; k++){
+		used += (uint64_t)OS_LoadWcet(&Loads[k])*1000/Loads[k].Period;
+	}
+	return (used < 1000) ? 1000-used : 0;
+}
+
+//******** OS_RtaReport *************** 
+// print the response time analysis of every periodic interrupt load with
+// declared and measured execution times, and the headroom left for threads
+// Inputs: none
+// Outputs: none
+void OS_RtaReport(void){
+	uint32_t k, response;
+	unsigned long headroom;
+	printf("Vector\tPri\tPeriod(us)\tWcet(us)\tMeasured(us)\tRuns\tResponse(us)\n\r");
+	for(k=0; k<g_NumLoads; k++){
+		response = OS_RtaResponse(k);
+		printf("%u\t%u\t%u\t\t%u\t\t%u.%02u\t\t%u\t%u%s\n\r",Loads[k].Vector,Loads[k].Priority,
+			Loads[k].Period/CYCLESPERUS,Loads[k].Wcet/CYCLESPERUS,Loads[k].Measured/CYCLESPERUS,
+			(Loads[k].Measured%CYCLESPERUS)*100/CYCLESPERUS,Loads[k].Runs,response/CYCLESPERUS,
+			(response > Loads[k].Period) ? " MISS" : "");
+	}
+	headroom = OS_RtaHeadroom();
+	printf("Headroom for threads %lu.%lu%%\n\r",headroom/10,headroom%10);
+}
+
+//**********OS_TimerNow************
+// bus cycles counting up, Timer1 counts down
+static uint32_t OS_TimerNow(void){
+	return 0 - OS_Time();
+}
+
+//**********OS_TimerSwap************
+// exchange two places in the expiry queue
+static void OS_TimerSwap(uint32_t i, uint32_t j){
+	OSTimerType* timer = TimerHeap[i];
+	TimerHeap[i] = TimerHeap[j];
+	TimerHeap[j] = timer;
+	TimerHeap[i]->HeapIndex = i;
+	TimerHeap[j]->HeapIndex = j;
+}
+
+//**********OS_TimerSift************
+// move the timer at place i up or down the heap until it is in order
+// expiry times are compared by difference so they can wrap
+static void OS_TimerSift(uint32_t i){
+	uint32_t parent, child;
+	while(i > 0){
+		parent = (i-1)/2;
+		if((int32_t)(TimerHeap[i]->Expiry - TimerHeap[parent]->Expiry) >= 0){
+			break;
+		}
+		OS_TimerSwap(i,parent);
+		i = parent;
+	}
+	while((child = 2*i+1) < g_NumTimersQueued){
+		if((child+1 < g_NumTimersQueued)&&
+			((int32_t)(TimerHeap[child+1]->Expiry - TimerHeap[child]->Expiry) < 0)){
+			child++;			// earlier of the two children
+		}
+		if((int32_t)(TimerHeap[child]->Expiry - TimerHeap[i]->Expiry) >= 0){
+			break;
+		}
+		OS_TimerSwap(i,child);
+		i = child;
+	}
+}
+
+//**********OS_TimerQueue************
+// add a timer to the expiry queue, called with interrupts disabled
+static void OS_TimerQueue(OSTimerType* timer){
+	timer->HeapIndex = g_NumTimersQueued;
+	TimerHeap[g_NumTimersQueued++] = timer;
+	OS_TimerSift(timer->HeapIndex);
+}
+
+//**********OS_TimerDequeue************
+// take a timer out of the expiry queue, called with interrupts disabled
+static void OS_TimerDequeue(OSTimerType* timer){
+	uint32_t i = timer->HeapIndex;
+	timer->HeapIndex = -1;
+	g_NumTimersQueued--;
+	if(i != g_NumTimersQueued){		// fill the hole with the last one
+		TimerHeap[i] = TimerHeap[g_NumTimersQueued];
+		TimerHeap[i]->HeapIndex = i;
+		OS_TimerSift(i);
+	}
+}
+
+//**********OS_TimerArm************
+// program Wide Timer 0A for the timer due next, called with interrupts disabled
+static void OS_TimerArm(void){
+	int32_t cycles;
+	if(g_NumTimersQueued == 0){
+		TIMER_OneShotStop();
+		return;
+	}
+	cycles = TimerHeap[0]->Expiry - OS_TimerNow();
+	if(cycles < MINTIMERCYCLES){
+		cycles = MINTIMERCYCLES;		// already due, let the interrupt come right away
+	}
+	TIMER_OneShotStart(cycles);
+}
+
+//**********OS_TimerHandler************
+// runs in the Wide Timer 0A interrupt, calls back every timer that is due,
+// requeues the periodic ones one period after their last expiry so they don't drift,
+// then programs the one-shot for the next one
+static void OS_TimerHandler(void){
+	OSTimerType* timer;
+	void(*callback)(void);
+	uint32_t now;
+	int32_t status;
+	TRACE(ISRENTRY,RunPt,110);			// Wide Timer 0A is vector 110
+	status = StartCritical();
+	now = OS_TimerNow();
+	while((g_NumTimersQueued > 0)&&((int32_t)(TimerHeap[0]->Expiry - now) <= 0)){
+		timer = TimerHeap[0];
+		callback = timer->Callback;
+		if(timer->OneShot){
+			OS_TimerDequeue(timer);
+		}else{
+			timer->Expiry += timer->Period;
+			if((int32_t)(timer->Expiry - now) <= 0){		// a whole period behind, skip the missed ones
+				timer->Expiry = now + timer->Period;
+				g_TimerOverruns++;
+			}
+			OS_TimerSift(0);
+		}
+		EndCritical(status);		// the callback may start or stop timers
+		callback();
+		status = StartCritical();
+		now = OS_TimerNow();
+	}
+	OS_TimerArm();
+	EndCritical(status);
+}
+
+//******** OS_TimerCreate *************** 
+// add a software timer, periodic or one-shot, and start it
+// every software timer runs off Wide Timer 0A, so it takes no GPTM or NVIC
+// priority of its own, the callbacks run in that interrupt one after another
+// Inputs: pointer to a void/void background function, same rules as OS_AddPeriodicThread
+//         period in us, 1 to 26000000
+//         1 for a one-shot timer, 0 for a periodic one
+// Outputs: handle for OS_TimerStart/Stop/Delete, NULL if the period is out of
+//          range or all NUMSWTIMERS are in use
+OSTimerType* OS_TimerCreate(void(*callback)(void), unsigned long period_us, int oneShot){
+	uint32_t i;
+	int32_t status;
+	if((callback==NULL)||(period_us==0)||(period_us>MAXTIMERUS)){
+		return NULL;
+	}
+	status = StartCritical();
+	for(i=0; i<NUMSWTIMERS; i++){
+		if(SwTimers[i].Callback==NULL){
+			SwTimers[i].Callback = callback;
+			SwTimers[i].Period = period_us*CYCLESPERUS;
+			SwTimers[i].OneShot = (oneShot != 0);
+			SwTimers[i].HeapIndex = -1;
+			OS_TimerStart(&SwTimers[i]);
+			EndCritical(status);
+			return &SwTimers[i];
+		}
+	}
+	EndCritical(status);
+	return NULL;
+}
+
+//******** OS_TimerStart *************** 
+// (re)start a software timer, it fires one period from now
+// Inputs: timer
+// Outputs: none
+void OS_TimerStart(OSTimerType* timer){
+	int32_t status;
+	status = StartCritical();
+	if(timer->HeapIndex >= 0){
+		OS_TimerDequeue(timer);
+	}
+	timer->Expiry = OS_TimerNow() + timer->Period;
+	OS_TimerQueue(timer);
+	if(timer->HeapIndex == 0){		// due before the one Wide Timer 0A was waiting for
+		OS_TimerArm();
+	}
+	EndCritical(status);
+}
+
+//******** OS_TimerStop *************** 
+// stop a software timer, it can be started again
+// Inputs: timer
+// Outputs: none
+void OS_TimerStop(OSTimerType* timer){
+	int32_t status;
+	status = StartCritical();
+	if(timer->HeapIndex >= 0){
+		OS_TimerDequeue(timer);		// if it was the next one due the interrupt just finds nothing to do
+	}
+	EndCritical(status);
+}
+
+//******** OS_TimerDelete *************** 
+// stop a software timer and give it back
+// Inputs: timer
+// Outputs: none
+void OS_TimerDelete(OSTimerType* timer){
+	int32_t status;
+	status = StartCritical();
+	OS_TimerStop(timer);
+	timer->Callback = NULL;
+	EndCritical(status);
+}
+
+//******** OS_Worker *************** 
+// body of every worker thread, takes the work queue of the priority it was
+// created at and runs its items in the order they were posted
+// workers may first run in any order, so the queue is looked up by priority
+static void OS_Worker(void){
+	struct workQueue* queue;
+	struct workItem item;
+	int32_t status;
+	status = StartCritical();
+	queue = WorkQueueOfPri[RunPt->Priority];		// holds no mutex yet, so this is its own priority
+	if((queue!=NULL)&&(queue->Worker==NULL)){
+		queue->Worker = RunPt;
+	}else{
+		queue = NULL;
+	}
+	EndCritical(status);
+	if(queue==NULL){
+		OS_Kill();
+	}
+	while(1){
+		OS_Wait(&queue->ItemsReady);
+		item = queue->Items[queue->GetI&(WORKQUEUESIZE-1)];
+		queue->GetI++;		// the slot is free once the item is copied out
+		(*item.Function)(item.Arg);
+	}
+}
+
+//******** OS_AddWorker *************** 
+// create the worker thread that runs deferred work at one priority
+// Inputs: priority of the worker, 1 is highest, EDFPRI is rejected like in OS_AddThread
+// Outputs: 1 if successful or there already is a worker at that priority,
+//          0 if all NUMWORKERS are in use or the thread can not be added
+int OS_AddWorker(unsigned long priority){
+	struct workQueue* queue;
+	int32_t status;
+	if((priority==EDFPRI)||(priority>=NUMPRI)){
+		return 0;
+	}
+	status = StartCritical();
+	if(WorkQueueOfPri[priority]!=NULL){
+		EndCritical(status);
+		return 1;
+	}
+	if(g_NumWorkers>=NUMWORKERS){
+		EndCritical(status);
+		return 0;
+	}
+	queue = &WorkQueues[g_NumWorkers];
+	queue->PutI = 0;
+	queue->GetI = 0;
+	OS_InitSemaphore(&queue->ItemsReady,0);
+	queue->Priority = priority;
+	queue->Worker = NULL;
+	queue->HighWater = 0;
+	queue->Overflows = 0;
+	if(OS_AddThread(&OS_Worker,WORKERSTACK,priority)==0){
+		EndCritical(status);
+		return 0;
+	}
+	g_NumWorkers++;		// the worker cannot run before this, interrupts are disabled
+	WorkQueueOfPri[priority] = queue;
+	EndCritical(status);
+	return 1;
+}
+
+//******** OS_WorkPost *************** 
+// hand a function to the worker thread at a priority, O(1) and safe to
+// call from an ISR, the function runs later in that thread's context
+// so it may block or sleep, items behind it wait until it returns
+// Inputs: function, argument passed to it, priority of the worker to run it
+// Outputs: 1 if queued, 0 if there is no worker at that priority or its
+//          queue is full (counted in Overflows)
+int OS_WorkPost(void(*function)(uint32_t), uint32_t arg, unsigned long priority){
+	struct workQueue* queue;
+	struct workItem* item;
+	uint32_t count;
+	int32_t status;
+	if((priority>=NUMPRI)||(WorkQueueOfPri[priority]==NULL)){
+		return 0;
+	}
+	queue = WorkQueueOfPri[priority];
+	status = StartCritical();		// more than one ISR may post to the same worker
+	count = queue->PutI - queue->GetI;
+	if(count>=WORKQUEUESIZE){
+		queue->Overflows++;
+		EndCritical(status);
+		return 0;
+	}
+	item = &queue->Items[queue->PutI&(WORKQUEUESIZE-1)];
+	item->Function = function;
+	item->Arg = arg;
+	queue->PutI++;
+	if(count+1 > queue->HighWater){
+		queue->HighWater = count+1;
+	}
+	EndCritical(status);
+	OS_Signal(&queue->ItemsReady);
+	return 1;
+}
+
+//******** OS_WorkReport *************** 
+// print priority, high water mark and overflows of every work queue
+// Inputs: none
+// Outputs: none
+void OS_WorkReport(void){
+	uint32_t k;
+	printf("Worker\tPri\tHighWater\tOverflows\n\r");
+	for(k=0; k<g_NumWorkers; k++){
+		printf("%u\t%u\t%u/%u\t\t%u\n\r",k,WorkQueues[k].Priority,WorkQueues[k].HighWater,
+			WORKQUEUESIZE,WorkQueues[k].Overflows);
+	}
+}
+
 //******** OS_AddSwitchTasks *************** 
 // add a background task to run whenever the SW1 (PF4) button is pushed
 // Inputs: pointer to a void/void background function
@@ -470,28 +1883,25 @@ int OS_AddSwitchTasks(void(*task1)(void), void(*task2)(void),unsigned long prior
 	NVIC_PRI7_R = (NVIC_PRI7_R&NVIC_PRI7_INT30_M)|(priority<<NVIC_PRI7_INT30_S);
 	NVIC_EN0_R = NVIC_EN0_INT30;
 	EndCritical(sr);
-	return 1;
-}
-
-void static DebounceSW1Task(void){
-	OS_Sleep(2);
-	LastPF4 = PF4;									//Store current value of switch
-	GPIO_PORTF_ICR_R |= 0x10;				//acknowledge interrupt
-	GPIO_PORTF_IM_R |= 0x10;				//Re-arm interrupt
-	OS_Kill();
+	return OS_AddWorker(SWITCHPRI);		// debouncing runs on it
 }
 
-void static DebounceSW2Task(void){
+//runs on the SWITCHPRI worker, pin is 0x10 for PF4 or 0x01 for PF0
+static void DebounceSwitch(uint32_t pin){
 	OS_Sleep(2);
-	LastPF0 = PF0;									//Store current value of switch
-	GPIO_PORTF_ICR_R |= 0x01;				//acknowledge
-	GPIO_PORTF_IM_R |= 0x01;				//Re-arm
-	OS_Kill();
+	if(pin==0x10){
+		LastPF4 = PF4;								//Store current value of switch
+	}else{
+		LastPF0 = PF0;
+	}
+	GPIO_PORTF_ICR_R |= pin;				//acknowledge interrupt
+	GPIO_PORTF_IM_R |= pin;					//Re-arm interrupt
 }
 #define PE5  (*((volatile unsigned long *)0x40024080))
 int interrupt_count = 0;
 void GPIOPortF_Handler(void){
 	uint32_t pin;
+	TRACE(ISRENTRY,RunPt,46);			//GPIO Port F is vector 46
 	interrupt_count++;
 	pin = GPIO_PORTF_RIS_R&0x11;   //which switch triggered the interrupt?
 	GPIO_PORTF_ICR_R |= pin;				//acknowledge
@@ -501,7 +1911,7 @@ void GPIOPortF_Handler(void){
 			(*PF4Task)();		
 		}
 		GPIO_PORTF_IM_R &= ~pin;	//disarm interrupt on PF4
-		if(OS_AddThread(&DebounceSW1Task,128,SWITCHPRI)==0){
+		if(OS_WorkPost(&DebounceSwitch,pin,SWITCHPRI)==0){
 			GPIO_PORTF_IM_R |= pin;
 		}
 	}
@@ -510,7 +1920,7 @@ void GPIOPortF_Handler(void){
 			(*PF0Task)();
 		}
 		GPIO_PORTF_IM_R &= ~pin;	//disarm interrupt on PF0
-		if(OS_AddThread(&DebounceSW2Task,128,SWITCHPRI)==0){
+		if(OS_WorkPost(&DebounceSwitch,pin,SWITCHPRI)==0){
 			GPIO_PORTF_IM_R |= pin;
 		}
 	}
@@ -533,24 +1943,20 @@ void OS_Sleep(unsigned long sleepTime){
 	{
 		status = StartCritical();
 		
-#ifdef PROFILER
-		ThreadArray[ThreadCount] = RunPt;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADSLEEP;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-		startTime = OS_Time();
-#endif						
+		TRACE(THREADSLEEP,RunPt,sleepTime);
 		
 		priority=RunPt->Priority;			//get priority of currently running thread
+		OS_SleepCatchUp(OS_Time64());	//sleepTime counts from the current ms
 		RunPt->SleepCtr = sleepTime; 	//set the sleep time
+		RunPt->SleepStatus = 1;
 		NextThread = RunPt->next;
 		if(LLRemove(&FrontOfPriLL[priority],RunPt,&EndOfPriLL[priority])){	//remove from the active list 
-			LLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);			//Add the thread to the sleeping list
-			HighestPriority&=~(1<<(31-priority));		//If it's the last thread at that priority, mark that bin as empty
+			SlpLLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);			//Add the thread to the sleeping list
+			HighestPriority&=~(1u<<(31-priority));		//If it's the last thread at that priority, mark that bin as empty
 			EndCritical(status);
 			OS_Suspend(JMP2HIGHERPRI); //since the highest priority thread is the last at that priority, re-evaluate highest priority
 		}else{
-			LLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);			//Add the thread to the sleeping lis
+			SlpLLAdd(&FrontOfSlpLL,RunPt,&EndOfSlpLL);			//Add the thread to the sleeping list
 			EndCritical(status);
 			OS_Suspend(JMPOVER);	//there are still threads at this priority level, so run normal round-robin
 		}
@@ -567,21 +1973,17 @@ void OS_Kill(void){
 	int32_t priority;
 	status = StartCritical(); 
 	
-#ifdef PROFILER
-		ThreadArray[ThreadCount] = RunPt;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADKILL;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-		startTime = OS_Time();
-#endif					
+	TRACE(THREADKILL,RunPt,0);
 	
-	RunPt->sp = NULL;							//free the tcb memory
-	RunPt->MemStatus = FREE;
+	// the TCB and stack are still in use until PendSV switches away,
+	// they are freed by the next OS_AddThread or OS_Kill
+	OS_ReclaimKilled();
+	KilledThread = RunPt;
 	priority = RunPt->Priority;
 	g_NumAliveThreads--;				//decrement number of alive threads
 	NextThread = RunPt->next;
 	if(LLRemove(&FrontOfPriLL[priority],RunPt,&EndOfPriLL[priority])){		//Linked list is empty at this priority
-		HighestPriority&=~(1<<(31-priority));		//indicate that there are no threads at this priority anymore
+		HighestPriority&=~(1u<<(31-priority));		//indicate that there are no threads at this priority anymore
 		EndCritical(status);
 		OS_Suspend(JMP2HIGHERPRI);		//There are no more threads at this priority, re-evaluate the highest priority
 	}else{
@@ -606,12 +2008,7 @@ void OS_Suspend(int PriChange){
 	uint32_t HiPri;
 	long sr = StartCritical();
 	
-#ifdef PROFILER
-		ThreadArray[ThreadCount] = RunPt;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADSUSPEND;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-#endif				
+	TRACE(THREADSUSPEND,RunPt,0);
 	
 	if(PriChange==1){
 		ProxyChange=1;
@@ -623,27 +2020,278 @@ void OS_Suspend(int PriChange){
 		ProxyThread=NextThread;
 	}
 	
-#ifdef PROFILER
-		ThreadArray[ThreadCount] = ProxyThread;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADSWITCH;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-#endif				
+	TRACE(THREADSWITCH,ProxyChange ? ProxyThread : RunPt->next,0);
 	
 	NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV; // does a contex switch 
 	OS_ResetSysTick(); // reset SysTick period
-
-#ifdef PROFILER		
-	DisableTimeTemp = OS_TimeDifference(startTime,OS_Time());
-	multAccDisTime += DisableTimeTemp;
-	if(DisableTimeTemp > DisableTime)
-	{
-		DisableTime = DisableTimeTemp;
-	}
-#endif 
 	EndCritical(sr);
 }
  
+//**********OS_FifoSetup************
+// empty a Fifo and point it at its buffer
+static void OS_FifoSetup(OSFifoType* fifo, void* buffer, uint32_t size, uint32_t elemSize){
+	fifo->Buffer = buffer;
+	fifo->Size = size;
+	fifo->ElemSize = elemSize;
+	fifo->PutI = 0;
+	fifo->GetI = 0;
+	fifo->Waiting = 0;
+	OS_InitSemaphore(&fifo->DataAvailable,0);
+	fifo->HighWater = 0;
+	fifo->Overflows = 0;
+}
+
+//**********OS_FifoCopy************
+// copy one entry, through volatile pointers so the compiler keeps the copy
+// ahead of the index update that hands the entry over
+static void OS_FifoCopy(uint8_t volatile *dst, const uint8_t volatile *src, uint32_t size){
+	if(size==4){
+		*(uint32_t volatile *)dst = *(const uint32_t volatile *)src;
+	}else if(size==2){
+		*(uint16_t volatile *)dst = *(const uint16_t volatile *)src;
+	}else{
+		while(size--){
+			*dst++ = *src++;
+		}
+	}
+}
+
+// ******** OS_FifoCreate ************
+// Make a new Fifo in a buffer supplied by the caller
+// Inputs:  buffer of size*elemSize bytes, aligned for the element type
+//          number of entries, must be a power of 2
+//          bytes per entry
+// Outputs: handle for the other OS_Fifo functions, NULL if size is not
+//          a power of 2 or all NUMFIFOS have been created
+OSFifoType* OS_FifoCreate(void* buffer, unsigned long size, unsigned long elemSize){
+	OSFifoType* fifo;
+	int32_t status;
+	if((buffer==NULL)||(size<2)||(size&(size-1))||(elemSize==0)){
+		return NULL;
+	}
+	status = StartCritical();
+	if(g_NumFifos>=NUMFIFOS){
+		EndCritical(status);
+		return NULL;
+	}
+	fifo = &Fifos[g_NumFifos++];
+	EndCritical(status);
+	OS_FifoSetup(fifo,buffer,size,elemSize);
+	return fifo;
+}
+
+// ******** OS_FifoPut ************
+// Copy one entry into a Fifo, never waits, may be called by an ISR
+// Inputs:  Fifo, pointer to elemSize bytes of data
+// Outputs: 1 if saved, 0 if the Fifo was full (counted in Overflows)
+// Lock free, the entry is stored before the index that publishes it and only
+// the producer writes PutI, so the consumer never sees a half written entry.
+// The semaphore is only signaled when the consumer has gone to sleep on it.
+int OS_FifoPut(OSFifoType* fifo, const void* data){
+	uint32_t putI = fifo->PutI;
+	uint32_t count = putI - fifo->GetI;
+	if(count >= fifo->Size){
+		fifo->Overflows++;
+		return FIFO_FAIL;
+	}
+	OS_FifoCopy(&fifo->Buffer[(putI&(fifo->Size-1))*fifo->ElemSize],data,fifo->ElemSize);
+	fifo->PutI = putI + 1;
+	if(count >= fifo->HighWater){
+		fifo->HighWater = count + 1;
+	}
+	if(fifo->Waiting && (count+1 >= fifo->Waiting)){		// consumer's batch is ready
+		fifo->Waiting = 0;
+		OS_Signal(&fifo->DataAvailable);
+	}
+	return FIFO_SUCCESS;
+}
+
+// ******** OS_FifoGet ************
+// Copy the oldest entry out of a Fifo, blocks while it is empty
+// Only one thread may get from a given Fifo, it takes no lock
+// Inputs:  Fifo, where to put elemSize bytes of data
+// Outputs: none
+void OS_FifoGet(OSFifoType* fifo, void* data){
+	uint32_t getI;
+	int32_t status;
+	while(fifo->GetI == fifo->PutI){		// empty, sleep until OS_FifoPut signals
+		status = StartCritical();
+		if(fifo->GetI == fifo->PutI){
+			fifo->Waiting = 1;
+			EndCritical(status);
+			OS_Wait(&fifo->DataAvailable);		// a Put before this leaves the count at 1, so the wakeup is not lost
+		}else{
+			EndCritical(status);
+		}
+	}
+	getI = fifo->GetI;
+	OS_FifoCopy(data,&fifo->Buffer[(getI&(fifo->Size-1))*fifo->ElemSize],fifo->ElemSize);
+	fifo->GetI = getI + 1;			// frees the entry for the producer
+}
+
+// ******** OS_FifoPutBlock ************
+// Copy up to n entries into a Fifo, never waits, may be called by an ISR
+// Inputs:  Fifo, n entries of elemSize bytes each, number of entries
+// Outputs: number saved, the ones that did not fit are counted in Overflows
+// All of them are published with one index update and at most one signal
+unsigned long OS_FifoPutBlock(OSFifoType* fifo, const void* src, unsigned long n){
+	const uint8_t *data = src;
+	uint32_t putI = fifo->PutI;
+	uint32_t count = putI - fifo->GetI;
+	uint32_t i, room = fifo->Size - count;
+	if(n > room){
+		fifo->Overflows += n - room;
+		n = room;
+	}
+	for(i=0; i<n; i++){
+		OS_FifoCopy(&fifo->Buffer[((putI+i)&(fifo->Size-1))*fifo->ElemSize],data,fifo->ElemSize);
+		data += fifo->ElemSize;
+	}
+	fifo->PutI = putI + n;
+	count += n;
+	if(count > fifo->HighWater){
+		fifo->HighWater = count;
+	}
+	if(fifo->Waiting && (count >= fifo->Waiting)){
+		fifo->Waiting = 0;
+		OS_Signal(&fifo->DataAvailable);
+	}
+	return n;
+}
+
+//**********OS_FifoBatch************
+// fewest entries a block get can wait for, 1 to maxN and never more than the Fifo holds
+static uint32_t OS_FifoBatch(OSFifoType* fifo, uint32_t maxN, uint32_t minN){
+	if(minN > maxN){
+		minN = maxN;
+	}
+	if(minN > fifo->Size){
+		minN = fifo->Size;			// could never be reached
+	}
+	if(minN == 0){
+		minN = 1;
+	}
+	return minN;
+}
+
+//**********OS_FifoTake************
+// copy up to maxN of the oldest entries out, called by the consumer only
+static uint32_t OS_FifoTake(OSFifoType* fifo, uint8_t* data, uint32_t maxN){
+	uint32_t getI, count, i;
+	getI = fifo->GetI;
+	count = fifo->PutI - getI;
+	if(count > maxN){
+		count = maxN;
+	}
+	for(i=0; i<count; i++){
+		OS_FifoCopy(data,&fifo->Buffer[((getI+i)&(fifo->Size-1))*fifo->ElemSize],fifo->ElemSize);
+		data += fifo->ElemSize;
+	}
+	fifo->GetI = getI + count;		// frees all of them for the producer at once
+	return count;
+}
+
+// ******** OS_FifoGetBlock ************
+// Copy up to maxN of the oldest entries out of a Fifo
+// Blocks until at least minN entries are in it, the producer only wakes the
+// consumer once that many are there (minN is limited to the Fifo size)
+// Only one thread may get from a given Fifo
+// Inputs:  Fifo, room for maxN entries, most to take, fewest to wait for
+// Outputs: number of entries copied
+unsigned long OS_FifoGetBlock(OSFifoType* fifo, void* dst, unsigned long maxN, unsigned long minN){
+	int32_t status;
+	if(maxN == 0){
+		return 0;
+	}
+	minN = OS_FifoBatch(fifo,maxN,minN);
+	while((fifo->PutI - fifo->GetI) < minN){		// sleep until OS_FifoPut has the batch ready
+		status = StartCritical();
+		if((fifo->PutI - fifo->GetI) < minN){
+			fifo->Waiting = minN;
+			EndCritical(status);
+			OS_Wait(&fifo->DataAvailable);
+		}else{
+			EndCritical(status);
+		}
+	}
+	return OS_FifoTake(fifo,dst,maxN);
+}
+
+// ******** OS_FifoGetBlockTimeout ************
+// OS_FifoGetBlock that blocks for at most timeout waiting for minN entries
+// Inputs:  Fifo, room for maxN entries, most to take, fewest to wait for,
+//          timeout in OS_Sleep units
+// Outputs: number of entries copied, fewer than minN (maybe 0) on a timeout
+// A signal that comes after a timeout leaves a stale count on DataAvailable,
+// the next wait returns at once on it and goes around the loop again
+unsigned long OS_FifoGetBlockTimeout(OSFifoType* fifo, void* dst, unsigned long maxN,
+	unsigned long minN, unsigned long timeout){
+	int32_t status;
+	if(maxN == 0){
+		return 0;
+	}
+	minN = OS_FifoBatch(fifo,maxN,minN);
+	while((fifo->PutI - fifo->GetI) < minN){
+		status = StartCritical();
+		if((fifo->PutI - fifo->GetI) < minN){
+			fifo->Waiting = minN;
+			EndCritical(status);
+			if(OS_WaitTimeout(&fifo->DataAvailable,timeout) == OS_TIMEOUT){
+				fifo->Waiting = 0;
+				break;			// hand over whatever did come in
+			}
+		}else{
+			EndCritical(status);
+		}
+	}
+	return OS_FifoTake(fifo,dst,maxN);
+}
+
+// ******** OS_FifoGetTimeout ************
+// Copy the oldest entry out of a Fifo, block for at most timeout if empty
+// Only one thread may get from a given Fifo
+// Inputs:  Fifo, where to put elemSize bytes of data, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if nothing came in time
+int OS_FifoGetTimeout(OSFifoType* fifo, void* data, unsigned long timeout){
+	if(OS_FifoGetBlockTimeout(fifo,data,1,1,timeout)){
+		return OS_SUCCESS;
+	}
+	return OS_TIMEOUT;
+}
+
+// ******** OS_FifoSize ************
+// Inputs:  Fifo
+// Outputs: number of entries in it
+long OS_FifoSize(OSFifoType* fifo){
+	return fifo->PutI - fifo->GetI;
+}
+
+// ******** OS_FifoStats ************
+// Capacity planning counters of a Fifo
+// Inputs:  Fifo, where to return the high water mark and the overflow count
+// Outputs: none
+void OS_FifoStats(OSFifoType* fifo, unsigned long* highWater, unsigned long* overflows){
+	*highWater = fifo->HighWater;
+	*overflows = fifo->Overflows;
+}
+
+// ******** OS_FifoReport ************
+// print size, entries, high water mark and overflows of every Fifo
+// Inputs:  none
+// Outputs: none
+void OS_FifoReport(void){
+	uint32_t i;
+	printf("Fifo\tSize\tElem\tNow\tHigh\tOverflows\n\r");
+	if(g_Fifo.Size){
+		printf("OS\t%u\t%u\t%ld\t%u\t%u\n\r",g_Fifo.Size,g_Fifo.ElemSize,OS_FifoSize(&g_Fifo),
+			g_Fifo.HighWater,g_Fifo.Overflows);
+	}
+	for(i=0; i<g_NumFifos; i++){
+		printf("%u\t%u\t%u\t%ld\t%u\t%u\n\r",i,Fifos[i].Size,Fifos[i].ElemSize,OS_FifoSize(&Fifos[i]),
+			Fifos[i].HighWater,Fifos[i].Overflows);
+	}
+}
+
 // ******** OS_Fifo_Init ************
 // Initialize the Fifo to be empty
 // Inputs: size
@@ -653,18 +2301,15 @@ void OS_Suspend(int PriChange){
 // In Lab 3, you can put whatever restrictions you want on size
 //    e.g., 4 to 64 elements
 //    e.g., must be a power of 2,4,8,16,32,64,128
+// size is rounded down to a power of 2 and limited to 128
+// use OS_FifoCreate for other sizes or more than one Fifo
 void OS_Fifo_Init(unsigned long size)
 {
-	g_FIFOSIZE = size;
-	// does this need to be protected???
-	// will it only be called at the beginning
-	g_Fifo = &Fifo[0];
-	g_fifoPutPtr = &g_Fifo[0];
-	g_fifoGetPtr = &g_Fifo[0];
-	
-	g_roomLeft.Value = g_FIFOSIZE;
-	g_dataAvailable.Value = 0;
-	g_fifoMutex.Value = 1; 
+	uint32_t entries = FIFOMAXSIZE;
+	while((entries > size)&&(entries > 2)){		//largest power of 2 that fits both size and FifoBuf
+		entries = entries/2;
+	}
+	OS_FifoSetup(&g_Fifo,FifoBuf,entries,sizeof(unsigned long));
 }
 
 // ******** OS_Fifo_Put ************
@@ -677,35 +2322,7 @@ void OS_Fifo_Init(unsigned long size)
 //  this function can not disable or enable interrupts
 int OS_Fifo_Put(unsigned long data)
 {
-	int32_t status;
-	unsigned long* nextPutPtr;
-	nextPutPtr = g_fifoPutPtr + 1;
-	
-//	OS_Wait(&g_roomLeft);
-//	OS_bWait(&g_fifoMutex); 
-	
-	if(nextPutPtr == &g_Fifo[g_FIFOSIZE])
-	{ //wrap
-		nextPutPtr = &g_Fifo[0];
-	}
-	if(nextPutPtr == g_fifoGetPtr)
-	{ // check for full FIFO
-		// You DON'T want to call OS_Signal(&g_dataAvailable 
-		// if you didn't add more data to the fifo 
-		status = FIFO_FAIL;
-		OS_bSignal(&g_fifoMutex); // release lock on g_fifoPutPtr
-	}
-	else
-	{ // only add data and update pointer if room left
-		
-		status = FIFO_SUCCESS;
-		*(g_fifoPutPtr) = data; // store data at current index
-		g_fifoPutPtr = nextPutPtr; // update PutPtr
-		OS_bSignal(&g_fifoMutex); // release lock on g_fifoPutPtr
-		OS_Signal(&g_dataAvailable); // signal you added data to the fifo and its ready to be read
-	}
-	return status;
-
+	return OS_FifoPut(&g_Fifo,&data);
 } 
 
 // ******** OS_Fifo_Get ************
@@ -713,22 +2330,11 @@ int OS_Fifo_Put(unsigned long data)
 // Called in foreground, will spin/block if empty
 // Inputs:  none
 // Outputs: data 
+// Only one thread may call it, the Fifo is single producer, single consumer
 unsigned long OS_Fifo_Get(void)
 {
 	unsigned long data;
-	
-	OS_Wait(&g_dataAvailable); // make sure there is no underflow & there is an element in the fifo to get
-	OS_bWait(&g_fifoMutex); // lock out the g_fifoGetPtr from all other threads
-	data = *(g_fifoGetPtr++); // get the data, then move to next index in fifo
-	
-	if(g_fifoGetPtr == &g_Fifo[g_FIFOSIZE])
-	{ // wrap
-		g_fifoGetPtr = &g_Fifo[0];
-	}
-	
-	OS_bSignal(&g_fifoMutex); // release lock on g_fifoGetPtr
-	OS_Signal(&g_roomLeft);
-	
+	OS_FifoGet(&g_Fifo,&data);
 	return data;
 }
 
@@ -741,10 +2347,155 @@ unsigned long OS_Fifo_Get(void)
 //          zero or less than zero if a call to OS_Fifo_Get will spin or block
 long OS_Fifo_Size(void)
 {
-	return g_roomLeft.Value;
+	return OS_FifoSize(&g_Fifo);
+}
+
+// ******** OS_Fifo_PutBlock ************
+// Enter up to n data samples into the Fifo, never waits
+// Inputs:  samples, number of samples
+// Outputs: number saved, the rest did not fit
+unsigned long OS_Fifo_PutBlock(const unsigned long* src, unsigned long n)
+{
+	return OS_FifoPutBlock(&g_Fifo,src,n);
+}
+
+// ******** OS_Fifo_GetBlock ************
+// Remove up to maxN data samples from the Fifo
+// Blocks until at least minN are in it, so the consumer is woken once per batch
+// Inputs:  where to put the samples, most to take, fewest to wait for
+// Outputs: number of samples removed, at least minN
+unsigned long OS_Fifo_GetBlock(unsigned long* dst, unsigned long maxN, unsigned long minN)
+{
+	return OS_FifoGetBlock(&g_Fifo,dst,maxN,minN);
+}
+
+// ******** OS_Fifo_GetTimeout ************
+// Remove one data sample from the Fifo, block for at most timeout if empty
+// Inputs:  where to put the sample, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if nothing came in time
+int OS_Fifo_GetTimeout(unsigned long* data, unsigned long timeout)
+{
+	return OS_FifoGetTimeout(&g_Fifo,data,timeout);
+}
+
+// ******** OS_PoolCreate ************
+// Make a pool of fixed size blocks in a buffer supplied by the caller
+// Inputs:  buffer of numBlocks*blockSize bytes, aligned for a pointer
+//          bytes per block, rounded up to a multiple of the pointer size
+//            so every free block can hold the free list link
+//          number of blocks
+// Outputs: handle for the other OS_Pool functions, NULL if the sizes are
+//          0, the buffer is misaligned or all NUMPOOLS have been created
+OSPoolType* OS_PoolCreate(void* buffer, unsigned long blockSize, unsigned long numBlocks){
+	OSPoolType* pool;
+	uint8_t* block;
+	uint32_t i;
+	int32_t status;
+	if((buffer==NULL)||(blockSize==0)||(numBlocks==0)||((uintptr_t)buffer&(sizeof(void*)-1))){
+		return NULL;
+	}
+	status = StartCritical();
+	if(g_NumPools>=NUMPOOLS){
+		EndCritical(status);
+		return NULL;
+	}
+	pool = &Pools[g_NumPools++];
+	EndCritical(status);
+	pool->BlockSize = (blockSize+sizeof(void*)-1)&~(sizeof(void*)-1);		// 4 on the board, 8 on the 64-bit host
+	pool->NumBlocks = numBlocks;
+	block = buffer;
+	for(i=0; i<numBlocks-1; i++){		// link every block to the one after it
+		*(void**)block = block + pool->BlockSize;
+		block += pool->BlockSize;
+	}
+	*(void**)block = NULL;
+	pool->FreeList = buffer;
+	OS_InitSemaphore(&pool->BlocksFree,numBlocks);
+	pool->InUse = 0;
+	pool->HighWater = 0;
+	pool->Failures = 0;
+	return pool;
+}
+
+// ******** OS_PoolTake ************
+// unlink the first free block, the caller holds a BlocksFree count for it
+static void* OS_PoolTake(OSPoolType* pool){
+	void* block;
+	int32_t status;
+	status = StartCritical();
+	block = pool->FreeList;
+	pool->FreeList = *(void**)block;
+	pool->InUse++;
+	if(pool->InUse > pool->HighWater){
+		pool->HighWater = pool->InUse;
+	}
+	EndCritical(status);
+	return block;
+}
+
+// ******** OS_PoolAlloc ************
+// Take a block from a pool, never waits, may be called by an ISR
+// Inputs:  pool
+// Outputs: the block, NULL if none was free (counted in Failures)
+void* OS_PoolAlloc(OSPoolType* pool){
+	return OS_PoolAllocTimeout(pool,0);
+}
+
+// ******** OS_PoolAllocTimeout ************
+// Take a block from a pool, block for at most timeout if none is free
+// Inputs:  pool, timeout in ms, 0 never waits
+// Outputs: the block, NULL if none was freed in time
+// A count of BlocksFree reserves one block, so a block freed for a
+// waiting thread cannot be taken by an ISR before that thread runs
+void* OS_PoolAllocTimeout(OSPoolType* pool, unsigned long timeout){
+	int32_t status;
+	if(OS_WaitTimeout(&pool->BlocksFree,timeout)==OS_TIMEOUT){
+		status = StartCritical();		// ISRs allocate too
+		pool->Failures++;
+		EndCritical(status);
+		return NULL;
+	}
+	return OS_PoolTake(pool);
+}
+
+// ******** OS_PoolFree ************
+// Give a block back to the pool it came from, may be called by an ISR
+// Inputs:  pool, block from OS_PoolAlloc or OS_PoolAllocTimeout
+// Outputs: none
+void OS_PoolFree(OSPoolType* pool, void* block){
+	int32_t status;
+	status = StartCritical();
+	*(void**)block = pool->FreeList;
+	pool->FreeList = block;
+	pool->InUse--;
+	EndCritical(status);
+	OS_Signal(&pool->BlocksFree);
+}
+
+// ******** OS_PoolStats ************
+// Capacity planning counters of a pool
+// Inputs:  pool, where to return the blocks in use, the most ever in use
+//          at once, and the allocations that found the pool empty
+// Outputs: none
+void OS_PoolStats(OSPoolType* pool, unsigned long* inUse, unsigned long* highWater, unsigned long* failures){
+	*inUse = pool->InUse;
+	*highWater = pool->HighWater;
+	*failures = pool->Failures;
+}
+
+// ******** OS_PoolReport ************
+// print block size, blocks, in use, high water mark and failures of every pool
+// Inputs:  none
+// Outputs: none
+void OS_PoolReport(void){
+	uint32_t i;
+	printf("Pool\tBlock\tBlocks\tInUse\tHigh\tFailures\n\r");
+	for(i=0; i<g_NumPools; i++){
+		printf("%u\t%u\t%u\t%u\t%u\t%u\n\r",i,Pools[i].BlockSize,Pools[i].NumBlocks,Pools[i].InUse,
+			Pools[i].HighWater,Pools[i].Failures);
+	}
 }
 
-// DA 2/20
 // ******** OS_MailBox_Init ************
 // Initialize communication channel
 // Clear mailboxData and set flag to empty
@@ -792,6 +2543,20 @@ unsigned long OS_MailBox_Recv(void)
 	return data;
 }
 
+// ******** OS_MailBox_RecvTimeout ************
+// remove mail from the MailBox, block for at most timeout if it is empty
+// Inputs:  where to put the data, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if no mail came in time
+int OS_MailBox_RecvTimeout(unsigned long* data, unsigned long timeout)
+{
+	if(OS_WaitTimeout(&g_mailboxDataValid,timeout) == OS_TIMEOUT){
+		return OS_TIMEOUT;
+	}
+	*data = g_mailboxData;
+	OS_bSignal(&g_mailboxFree); // signal that the mailbox is empty and can accept new data
+	return OS_SUCCESS;
+}
+
 // ******** OS_Time ************
 // return the system time using SysTick
 // Inputs:  none
@@ -815,48 +2580,115 @@ unsigned long OS_Time(void)
 // this function and OS_Time have the same resolution and precision 
 unsigned long OS_TimeDifference(unsigned long start, unsigned long stop)
 {
-	// NOTE: This cannot accurately account for time differences
-	// when you roll over. Requires: start > end & that both have been
-	// read within the same SysTick Period
+	// Timer1 counts down over the full 32 bits, so the unsigned
+	// difference is right across a rollover as long as less than
+	// 53.7 s went by, OS_Time64 covers longer intervals
 	unsigned long diff;
 	diff = (start - stop);
 	return diff;
 }
 
+// ******** OS_Time64 ************
+// monotonic system time, Timer1 extended with a count of its rollovers
+// Timer1 counts down, so a value above the last one read means it wrapped.
+// SysTick calls this every time slice (at most every 2^24 cycles in
+// tickless mode), far more often than the 53.7 s Timer1 takes to wrap,
+// so no rollover is missed without a Timer1 interrupt
+// Inputs:  none
+// Outputs: 12.5ns units since OS_Init
+uint64_t OS_Time64(void){
+	int32_t status;
+	uint32_t now;
+	uint64_t time;
+	status = StartCritical();		// wrap count and last value must change together
+	now = TIMER1_TAR_R;
+	if(now > g_LastTimer1){
+		g_Timer1Wraps++;
+	}
+	g_LastTimer1 = now;
+	time = ((uint64_t)g_Timer1Wraps<<32) + (0xFFFFFFFF - now);
+	EndCritical(status);
+	return time;
+}
+
+//********OS_SleepCatchUp**********
+//count the sleeping list down by the whole ms since it was last counted,
+//expired threads are woken by the next SysTick
+//must be called with interrupts disabled
+//input: OS_Time64 value of now
+static void OS_SleepCatchUp(uint64_t now){
+	uint32_t ms;
+	ms = (uint32_t)(now - g_SleepTime)/TIME_1MS;
+	g_SleepTime += (uint64_t)ms*TIME_1MS;
+	if(FrontOfSlpLL!=NULL){
+		FrontOfSlpLL->SleepCtr -= ms;
+	}
+}
+
 // DA 2/22
 // ******** OS_ClearMsTime ************
 // sets the system time to zero (from Lab 1)
-// Essentially disables SysTick
 // Inputs:  none
 // Outputs: none
 // You are free to change how this works
 void OS_ClearMsTime(void)
 {	
-	g_msTime = 0; // atomic
+	g_MsTimeBase = OS_Time64();
 }
 
+// ******** OS_ResetSysTick ************
+// start a new SysTick period, called on every thread switch
+// In tickless mode the period runs to the next sleeper's wakeup, or as long
+// as the 24-bit SysTick allows, when the thread about to run has nothing to
+// round-robin with. Sleep times are kept by OS_Time64, so SysTick periods
+// can be cut short or stretched without losing time.
 void OS_ResetSysTick(void)
 {
-	// Need to do this for SysTick since that
-	// is what we are using for the system time
-	// any write to NVIC_ST_CURRENT_R resets it to the
-	// NVIC_ST_RELOAD_R value
-	// This would mess up the msTime if you remove systick's periodicity
 	int32_t status = StartCritical();
-	NVIC_ST_CURRENT_R = 10;
+	uint64_t now;
+	uint32_t cycles, wake;
+	tcbType* nextThread;
+	if(g_Tickless){
+		now = OS_Time64();
+		OS_SleepCatchUp(now);
+		NVIC_INT_CTRL_R = NVIC_INT_CTRL_PENDSTCLR;		// the new period covers an expired one that could not run yet
+		// find the thread that runs until the next SysTick
+		if(NVIC_INT_CTRL_R&NVIC_INT_CTRL_PEND_SV){
+			nextThread = ProxyChange ? ProxyThread : RunPt->next;
+		}else{
+			nextThread = ProxyChange ? NULL : RunPt;		// a higher priority thread is waiting for the next SysTick
+		}
+		cycles = g_TimeSlice;
+		if((nextThread!=NULL)&&(nextThread->next==nextThread)){	// nothing to round-robin with, skip to the next wakeup
+			cycles = NVIC_ST_RELOAD_M+1;
+			if(FrontOfSlpLL!=NULL){
+				if(FrontOfSlpLL->SleepCtr <= 0){
+					cycles = 0;		// expired, wake it as soon as possible
+				}else if(FrontOfSlpLL->SleepCtr < (int32_t)(cycles/TIME_1MS + 1)){
+					wake = FrontOfSlpLL->SleepCtr*TIME_1MS - (uint32_t)(now - g_SleepTime);
+					if(wake < cycles){cycles = wake;}
+				}
+			}
+		}
+		if(cycles < MINRELOAD){cycles = MINRELOAD;}
+		g_Stretched = (cycles > g_TimeSlice);
+		NVIC_ST_RELOAD_R = cycles - 1;
+		NVIC_ST_CURRENT_R = 0;
+	}else{
+		NVIC_ST_CURRENT_R = 10;
+	}
 	EndCritical(status);
 }
 
 // ******** OS_MsTime ************
 // reads the current time in msec (from Lab 1)
 // Inputs:  none
-// Outputs: time in ms units
+// Outputs: time in ms units since OS_ClearMsTime
 // You are free to select the time resolution for this function
 // It is ok to make the resolution to match the first call to OS_AddPeriodicThread
 unsigned long OS_MsTime(void)
-{ // this is the msTime since SysTick has started counting
-	// It only updates when SysTick interrupts occur
-	return g_msTime; // it actually is in ms
+{
+	return (unsigned long)((OS_Time64() - g_MsTimeBase)/TIME_1MS);
 }
 
 //******** OS_Launch *************** 
@@ -876,9 +2708,26 @@ void OS_Launch(unsigned long theTimeSlice){
 	NVIC_ST_RELOAD_R = theTimeSlice - 1; // reload value
   NVIC_ST_CTRL_R = NVIC_ST_CTRL_ENABLE+NVIC_ST_CTRL_CLK_SRC+NVIC_ST_CTRL_INTEN;// enable, core clock and interrupt arm
 	#endif
+	g_TimeSlice = theTimeSlice;
+	RunPt->LastRun = OS_Time();		// start of its RunTime
+	RunPt->SwitchCount = 1;
   StartOS();                   // start on the first task
 }
 
+//******** OS_LaunchTickless *************** 
+// start the scheduler in tickless mode, enable interrupts
+// Same as OS_Launch, but whenever the thread that is about to run has no
+// other thread to round-robin with, SysTick is reprogrammed to fire at the
+// next sleep expiry (or as late as the 24-bit SysTick allows) instead of
+// every time slice. Sleep times and OS_MsTime come from OS_Time64, so they
+// do not depend on the SysTick period. Pair it with an idle thread that runs WFI.
+// Inputs: number of 12.5ns clock cycles for each time slice
+// Outputs: none (does not return)
+void OS_LaunchTickless(unsigned long theTimeSlice){
+	g_Tickless = 1;
+	OS_Launch(theTimeSlice);
+}
+
 
 // Resets the 32-bit counter to zero
 // DA 2/20	
@@ -993,90 +2842,279 @@ void Jitter(void){
 	printf("MaxJitterA: %d\n\r",MaxJitter);
 	printf("MaxJitterB: %d\n\r",MaxJitterB);
 }
+
+//******** OS_ThreadStats *************** 
+// print CPU usage of every live thread
+// RunTime is charged by PendSV_Handler, so the running thread's share only
+// counts up to its last switch in
+void OS_ThreadStats(void){
+	int k;
+	uint64_t total=0;
+	uint64_t runTime[NUMTHREADS];
+	uint32_t switches[NUMTHREADS];
+	uint32_t lastRun[NUMTHREADS];
+	uint32_t now;
+	int32_t status;
+	status = StartCritical();		// take a consistent snapshot
+	now = OS_Time();
+	for(k=0; k<NUMTHREADS; k++){
+		runTime[k] = tcbs[k].RunTime;
+		switches[k] = tcbs[k].SwitchCount;
+		lastRun[k] = tcbs[k].LastRun;
+		if(tcbs[k].MemStatus==USED){
+			total += runTime[k];
+		}
+	}
+	EndCritical(status);
+	total = total/1000;		// per mille
+	if(total==0){total = 1;}
+	printf("ID\tPri\tCPU%%\tSwitches\tLastRun(ms ago)\n\r");
+	for(k=0; k<NUMTHREADS; k++){
+		if(tcbs[k].MemStatus==USED){
+			printf("%d\t%d\t%u.%u\t%u\t\t%u\n\r",tcbs[k].ID,tcbs[k].Priority,
+				(uint32_t)(runTime[k]/total/10),(uint32_t)(runTime[k]/total%10),switches[k],(uint32_t)(OS_TimeDifference(lastRun[k],now)/TIME_1MS));
+		}
+	}
+}
  
+#ifdef PROFILER
+//********OS_Trace**********
+//Adds one record to the trace ring, overwriting the oldest when full
+//Inputs: event type, thread the event is about (NULL if none),
+//        object, only the low 16 bits are kept (enough for any SRAM address)
+//Outputs: none
+void OS_Trace(uint32_t event, tcbType* thread, uint32_t object){
+	struct traceRecord* record;
+	uint64_t now;
+	int32_t status;
+	status = StartCritical();
+	if(TraceStopped){
+		EndCritical(status);
+		return;
+	}
+	now = OS_Time64();
+	record = &TraceBuffer[TraceCount&(TRACESIZE-1)];
+	record->TimeDelta = (now - TraceLastTime > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)(now - TraceLastTime);		//saturates after 53.7 s of quiet
+	record->Event = event;
+	record->ThreadID = (thread==NULL) ? 0xFF : thread->ID;
+	record->Object = object;
+	TraceLastTime = now;
+	TraceCount++;
+	EndCritical(status);
+}
+#endif
+
+// ******** OS_TraceDump ************
+// print the trace ring, oldest record first, tracing stops while it prints
+// "TRACE n" line, n lines of 16 hex digits (delta, event, ID, object), "END" line
+// the first delta is relative to a record that was already overwritten
+void OS_TraceDump(void){
+	uint32_t i, first;
+	struct traceRecord* record;
+	TraceStopped = 1;
+	first = (TraceCount > TRACESIZE) ? TraceCount-TRACESIZE : 0;
+	printf("TRACE %u\n\r",TraceCount-first);
+	for(i=first; i<TraceCount; i++){
+		record = &TraceBuffer[i&(TRACESIZE-1)];
+		printf("%08x%02x%02x%04x\n\r",record->TimeDelta,record->Event,record->ThreadID,record->Object);
+	}
+	printf("END\n\r");
+	TraceCount = 0;
+	TraceStopped = 0;
+}
+
+#ifdef PROFILER
+#define KERNELBASEPRI (OS_KERNELPRI<<5)		// same as osasm.s
+#ifdef HOSTSIM
+#define CALLSITE() ((uint32_t)(uintptr_t)__builtin_return_address(0))
+#else
+#define CALLSITE() ((uint32_t)__return_address())
+#endif
+
+//********OS_CritRecord**********
+//Adds one outermost critical section to its call site, still masked
+//Inputs: call site, length in 12.5ns units
+//Outputs: none
+static void OS_CritRecord(uint32_t site, uint32_t length){
+	critSiteType* record;
+	uint32_t i, k, bucket;
+	i = ((site>>1)*2654435761u)>>(32-6);		// Fibonacci hash, 6 = log2(CRITSITES)
+	for(k=0; k<CRITSITES; k++){
+		record = &CritSites[(i+k)&(CRITSITES-1)];
+		if(record->Site==site || record->Site==0){
+			break;
+		}
+	}
+	if(k==CRITSITES){
+		CritOverflow++;
+		return;
+	}
+	record->Site = site;
+	record->Count++;
+	record->Total += length;
+	if(length > record->Max){
+		record->Max = length;
+	}
+	for(bucket=0; (length>>1)!=0 && bucket<CRITBUCKETS-1; bucket++){
+		length = length>>1;
+	}
+	record->Hist[bucket]++;
+}
+
+// ******** StartCritical ************
+// profiled version of the one in osasm.s, raises BASEPRI to the kernel band
+// and opens a timed section when interrupts were not already masked
+// Inputs:  none
+// Outputs: previous BASEPRI, pass it to EndCritical
+int32_t StartCritical(void){
+	unsigned long basepri;
+	basepri = CPUbasepriGet();
+	if(basepri==0 || basepri>KERNELBASEPRI){
+		CPUbasepriSet(KERNELBASEPRI);		// BASEPRI_MAX, never lowers the mask
+	}
+	if(basepri==0){
+		CritSite = CALLSITE();
+		CritStart = OS_Time();
+	}
+	return basepri;
+}
+
+// ******** EndCritical ************
+// profiled version of the one in osasm.s, charges the section to its
+// call site before BASEPRI goes back to what StartCritical returned
+// Inputs:  value StartCritical returned
+// Outputs: none
+void EndCritical(int32_t basepri){
+	if(basepri==0 && CritSite!=0){
+		OS_CritRecord(CritSite,OS_TimeDifference(CritStart,OS_Time()));
+		CritSite = 0;
+	}
+	CPUbasepriSet(basepri);
+}
+
+// ******** OS_CritWorst ************
+// rank the call sites by their longest masked time
+// Inputs:  rank, 0 is the worst offender
+// Outputs: the site's record, NULL if fewer sites have been seen
+critSiteType* OS_CritWorst(uint32_t rank){
+	critSiteType* worst;
+	uint32_t i, k, max, above;
+	worst = NULL;
+	for(i=0; i<CRITSITES; i++){
+		if(CritSites[i].Site==0){
+			continue;
+		}
+		above = 0;		// sites that rank ahead of this one, ties go to the lower slot
+		max = CritSites[i].Max;
+		for(k=0; k<CRITSITES; k++){
+			if(CritSites[k].Site!=0 && (CritSites[k].Max>max || (CritSites[k].Max==max && k<i))){
+				above++;
+			}
+		}
+		if(above==rank){
+			worst = &CritSites[i];
+			break;
+		}
+	}
+	return worst;
+}
+
+// ******** OS_CritReport ************
+// print the worst offenders with their histograms, then how many
+// sections had no free slot
+// "site count max(us) mean(us)" then the nonzero buckets as 2^k:count
+// Inputs:  number of sites to print
+// Outputs: none
+void OS_CritReport(uint32_t top){
+	critSiteType snapshot;
+	critSiteType* record;
+	uint32_t rank, k;
+	int32_t status;
+	printf("Masked time per call site, look the sites up in the map file\n\r");
+	printf("Site\t\tCount\tMax(us)\tMean(us)\tHistogram(2^k cycles:count)\n\r");
+	for(rank=0; rank<top; rank++){
+		status = StartCritical();
+		record = OS_CritWorst(rank);
+		if(record!=NULL){
+			snapshot = *record;
+		}
+		EndCritical(status);
+		if(record==NULL){
+			break;
+		}
+		printf("0x%08x\t%u\t%u.%02u\t%u.%02u\t\t",snapshot.Site,snapshot.Count,
+			snapshot.Max/80,(snapshot.Max%80)*100/80,
+			(uint32_t)(snapshot.Total/snapshot.Count/80),(uint32_t)(snapshot.Total/snapshot.Count%80)*100/80);
+		for(k=0; k<CRITBUCKETS; k++){
+			if(snapshot.Hist[k]){
+				printf(" %u:%u",k,snapshot.Hist[k]);
+			}
+		}
+		printf("\n\r");
+	}
+	printf("Untracked sections %u\n\r",CritOverflow);
+}
+
+// ******** OS_CritReset ************
+// forget every call site and start measuring again
+// Inputs:  none
+// Outputs: none
+void OS_CritReset(void){
+	uint32_t i, k;
+	int32_t status;
+	status = StartCritical();
+	for(i=0; i<CRITSITES; i++){
+		CritSites[i].Site = 0;
+		CritSites[i].Count = 0;
+		CritSites[i].Max = 0;
+		CritSites[i].Total = 0;
+		for(k=0; k<CRITBUCKETS; k++){
+			CritSites[i].Hist[k] = 0;
+		}
+	}
+	CritOverflow = 0;
+	CritSite = 0;		// the open section is this one, drop it
+	EndCritical(status);
+}
+#endif
+
 //********OS_WakeUpSleeping**********
-//Iterates through the sleeping linked list and decrements counters
+//The sleeping linked list is a delta queue ordered by wakeup time, so only
+//the front counter is decremented and only expired threads are visited
 //Moves the woken threads from the sleeping list to the active list
 //returns 1 if a change in highest priority occured
 //returns 0 if no change in highest priority occured
-static int OS_WakeUpSleeping(void){
-	tcbType* sleepIterator;
+//input: OS_Time64 value of now
+static int OS_WakeUpSleeping(uint64_t now){
+	tcbType* wokenThread;
+	Sema4Type* semaPt;
 	uint32_t priority;
 	uint32_t priChange=0;
-	tcbType* wokenThreads[NUMTHREADS-1];
-	uint32_t i=0,k=0;
 	
+	OS_SleepCatchUp(now);		//decrement sleep counter of the first thread to wake up
 	if(FrontOfSlpLL==NULL){
 		return 0;
 	}   //Sleeping list is empty
-	sleepIterator = FrontOfSlpLL;
-	if(FrontOfSlpLL==EndOfSlpLL){				//Sleeping list has one element in it
-		FrontOfSlpLL->SleepCtr -= SYSTICK_PERIOD;		//decrement sleep counter
-		if(FrontOfSlpLL->SleepCtr <= 0){		//If done sleeping move from sleeping linked list to active list
-			priority = FrontOfSlpLL->Priority;
-			LLRemove(&FrontOfSlpLL,sleepIterator,&EndOfSlpLL);
-			if(LLAdd(&FrontOfPriLL[priority],sleepIterator,&EndOfPriLL[priority])){			
-				if(1<<(31-priority) > HighestPriority){			//Indicate if priority change occurred
-					
-#ifdef PROFILER
-				ThreadArray[ThreadCount] = sleepIterator;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADWAKERUN;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-#endif					
-					
-					HighestPriority|=1<<(31-priority);
-					return 1;
-				}
-			}else return 0;
-		} else return 0;
-		
-	}else{
-		
-		//More than 1 element in sleeping list
-		for(sleepIterator=FrontOfSlpLL->next; sleepIterator!=FrontOfSlpLL; sleepIterator=sleepIterator->next){
-			sleepIterator->SleepCtr -= SYSTICK_PERIOD;
-			if(sleepIterator->SleepCtr <= 0){
-				wokenThreads[i++]=sleepIterator;
-				priority = sleepIterator->Priority;
-			}	
+	while((FrontOfSlpLL!=NULL)&&(FrontOfSlpLL->SleepCtr <= 0)){		//If done sleeping move from sleeping linked list to active list
+		wokenThread = FrontOfSlpLL;
+		SlpLLRemove(&FrontOfSlpLL,wokenThread,&EndOfSlpLL);		//the time past this wakeup counts against the next one
+		wokenThread->SleepCtr = 0;
+		wokenThread->SleepStatus = 0;
+		wokenThread->NotifyWaiting = 0;		//a notification that comes in now must not wake it again
+		semaPt = wokenThread->BlockedStatus;
+		if(semaPt!=NULL){		//timed wait ran out, leave the semaphore without taking it
+			LLRemove(&semaPt->FrontPt,wokenThread,&semaPt->EndPt);
+			semaPt->Value = semaPt->Value + 1;
+			wokenThread->BlockedStatus = NULL;
+			wokenThread->TimedOut = 1;
 		}
-		for(k=0; k<i; k++){
-			LLRemove(&FrontOfSlpLL,wokenThreads[k],&EndOfSlpLL);
-			if(LLAdd(&FrontOfPriLL[priority],wokenThreads[k],&EndOfPriLL[priority])){			
-				if(1<<(31-priority) > HighestPriority){
-					
-#ifdef PROFILER
-					ThreadArray[ThreadCount] = wokenThreads[k];
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADWAKERUN;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-#endif							
-					HighestPriority|=1<<(31-priority);
-					priChange = 1;
-				}
-			}
+		priority = wokenThread->Priority;
+		OS_ActiveAdd(wokenThread);
+		TRACE(THREADWAKERUN,wokenThread,semaPt);
+		if((1u<<(31-priority) > HighestPriority)||OS_Outranks(wokenThread,RunPt)){			//Indicate if priority change occurred
+			priChange = 1;
 		}
-		sleepIterator = FrontOfSlpLL;
-		FrontOfSlpLL->SleepCtr -= SYSTICK_PERIOD;		//decrement sleep counter
-		if(FrontOfSlpLL->SleepCtr <= 0){		//If done sleeping move from sleeping linked list to active list
-			priority = FrontOfSlpLL->Priority;
-			LLRemove(&FrontOfSlpLL,sleepIterator,&EndOfSlpLL);
-			if(LLAdd(&FrontOfPriLL[priority],sleepIterator,&EndOfPriLL[priority])){			
-				if(1<<(31-priority) > HighestPriority){			//Indicate if priority change occurred
-					HighestPriority|=1<<(31-priority);
-					
-#ifdef PROFILER
-					ThreadArray[ThreadCount] = sleepIterator;
-					ThreadTime[ThreadCount] = OS_Time();
-					ThreadAction[ThreadCount++] = THREADWAKERUN;
-					if (ThreadCount == PROFSIZE){ThreadCount=0;}
-#endif											
-					
-					priChange = 1;
-				}
-			}else priChange = 0;
-		} else priChange = 0;
+		HighestPriority|=1u<<(31-priority);
 	}
 	return priChange;
 }
@@ -1086,19 +3124,28 @@ void SysTick_Handler(void)
 	int status;
 	uint32_t HiPri;
 	status = StartCritical(); 
+	TRACE(ISRENTRY,RunPt,15);			//SysTick is vector 15
 #ifdef PROFILER
 	startTime = OS_Time();
 #endif	
 	
-	g_msTime += SYSTICK_PERIOD;
-	//Wake up sleeping threads
+	g_Stretched = 0;
+	//Wake up sleeping threads, this also keeps OS_Time64 ahead of Timer1 rollovers
 	
-	if(OS_WakeUpSleeping()){		//If a change in highest priority occured, suspend with re-evaluation of highest priority
+	if(OS_WakeUpSleeping(OS_Time64())){		//If a change in highest priority occured, suspend with re-evaluation of highest priority
+#ifdef PROFILER
+		SysTickCycles = OS_TimeDifference(startTime,OS_Time());
+		if(SysTickCycles > SysTickMaxCycles){SysTickMaxCycles = SysTickCycles;}
+#endif
 		EndCritical(status);
 		OS_Suspend(JMP2HIGHERPRI);
 	}
+#ifdef PROFILER
+	SysTickCycles = OS_TimeDifference(startTime,OS_Time());
+	if(SysTickCycles > SysTickMaxCycles){SysTickMaxCycles = SysTickCycles;}
+#endif
 	EndCritical(status);
-	OS_Suspend(NORMALRR); 
+	OS_Suspend((RunPt->EDF!=NULL) ? JMP2HIGHERPRI : NORMALRR); 	//EDF jobs are not round-robined, the earliest deadline keeps running
 }
 	
 
@@ -13,6 +13,7 @@
 // Holds the function pointers to the threads that will be launched
 extern void(*HandlerTaskArray[12])(void); 
 #include <stdlib.h>
+#include <stdint.h>
 #include "tm4c123gh6pm.h"
 
 // edit these depending on your clock        
@@ -24,10 +25,74 @@ extern void(*HandlerTaskArray[12])(void);
 typedef struct tcb tcbType;
 
 //#define PROFILER 1
-#define PROFSIZE 1000
-extern unsigned long ThreadTime[PROFSIZE];
-extern unsigned long ThreadAction[PROFSIZE];
-extern tcbType* ThreadArray[PROFSIZE];
+// kernel trace, a ring of packed 8-byte records
+// dumped as hex by OS_TraceDump, host/trace2json.c turns it into Chrome trace JSON
+#define TRACESIZE 1024		// records, must be a power of 2
+#define THREADSUSPEND 0		// thread gave up the CPU, object unused
+#define THREADKILL 		1
+#define THREADSLEEP 	2		// object is the sleep time in ms
+#define THREADWAKERUN	3		// thread left the sleeping list, object is the semaphore if a timed wait ran out
+#define THREADSWITCH 	4		// thread picked to run next
+#define THREADBLOCK		5		// thread blocked, object is the semaphore
+#define THREADUNBLOCK	6		// thread woken by a signal, object is the semaphore
+#define ISRENTRY			7		// object is the interrupt vector number
+struct traceRecord{
+	uint32_t TimeDelta;		// 12.5ns units since the previous record
+	uint8_t Event;
+	uint8_t ThreadID;			// tcb ID, 0xFF if none
+	uint16_t Object;			// low half of an object address or an event specific number
+};
+#ifdef PROFILER
+void OS_Trace(uint32_t event, tcbType* thread, uint32_t object);
+#define TRACE(EVENT,THREAD,OBJECT) OS_Trace(EVENT,THREAD,(uint32_t)(uintptr_t)(OBJECT))
+#else
+#define TRACE(EVENT,THREAD,OBJECT)
+#endif
+
+// ******** OS_TraceDump ************
+// print the trace ring, oldest record first, tracing stops while it prints
+// "TRACE n" line, n lines of 16 hex digits (delta, event, ID, object), "END" line
+// Inputs:  none
+// Outputs: none
+void OS_TraceDump(void);
+
+// interrupt masked time per call site, kept when PROFILER is defined
+// StartCritical/EndCritical in OS.c replace the weak ones in osasm.s and time
+// each outermost critical section, the site is the address StartCritical
+// returns to, look it up in the map file or disassembly
+// histogram bucket k counts sections of 2^k to 2^(k+1)-1 bus cycles
+#define CRITSITES 64			// distinct call sites tracked, must be a power of 2
+#define CRITBUCKETS 16		// the last bucket also takes everything longer, 2^15 cycles = 410 us
+struct critSite{
+	uint32_t Site;				// return address of StartCritical, 0 if the slot is free
+	uint32_t Count;				// critical sections timed
+	uint32_t Max;					// longest, 12.5ns units
+	uint64_t Total;				// sum, 12.5ns units
+	uint32_t Hist[CRITBUCKETS];
+};
+typedef struct critSite critSiteType;
+
+// ******** OS_CritWorst ************
+// rank the call sites by their longest masked time
+// Inputs:  rank, 0 is the worst offender
+// Outputs: the site's record, NULL if fewer sites have been seen
+//   the record keeps counting, copy it inside a critical section for a snapshot
+critSiteType* OS_CritWorst(uint32_t rank);
+
+// ******** OS_CritReport ************
+// print the worst offenders with their histograms, then how many
+// sections had no free slot
+// Inputs:  number of sites to print
+// Outputs: none
+void OS_CritReport(uint32_t top);
+
+// ******** OS_CritReset ************
+// forget every call site and start measuring again
+// Inputs:  none
+// Outputs: none
+void OS_CritReset(void);
+extern unsigned long SysTickCycles;		// time in the last SysTick wakeup, 12.5ns units
+extern unsigned long SysTickMaxCycles;
 
 #define NUMPRI 32
 //Priority Array of Round-Robin Linked Lists
@@ -42,6 +107,96 @@ struct  Sema4{
 	tcbType* EndPt;
 };
 typedef struct Sema4 Sema4Type;
+
+// event group, threads block until any or all of a set of bits are set
+// waiters are kept on Waiters in priority order through BlockedStatus,
+// Waiters.Value is minus the number of them
+struct OSEventGroup{
+	Sema4Type Waiters;
+	uint32_t Bits;
+};
+typedef struct OSEventGroup OSEventGroupType;
+#define OS_EVENT_ALL 1		// OS_EventWait option, wait for every bit instead of any
+#define OS_EVENT_CLEAR 2	// OS_EventWait option, clear the bits waited for once satisfied
+
+// mutex with priority inheritance, while a thread is blocked on it
+// the owner runs at the priority of that thread
+struct Mutex{
+	Sema4Type Sema4;							// 1 means free, blocked threads kept in priority order
+	tcbType* Owner;								// NULL when free
+	struct Mutex* NextHeld;				// next mutex on the owner's Held list
+	unsigned long MaxBlockTime;		// longest time a thread waited for this mutex, 12.5ns units
+};
+typedef struct Mutex MutexType;
+
+// single producer, single consumer queue made by OS_FifoCreate
+// the producer may be an ISR, the consumer is one thread
+struct OSFifo{
+	uint8_t volatile *Buffer;		// Size*ElemSize bytes supplied by the caller
+	uint32_t Size;							// entries, a power of 2
+	uint32_t ElemSize;					// bytes per entry
+	uint32_t volatile PutI;			// free running, only the producer writes it
+	uint32_t volatile GetI;			// free running, only the consumer writes it
+	uint32_t volatile Waiting;	// entries the blocked consumer needs, 0 while it is not blocked
+	Sema4Type DataAvailable;
+	uint32_t HighWater;					// most entries that were ever in it at once
+	uint32_t Overflows;					// puts that found it full
+};
+typedef struct OSFifo OSFifoType;
+
+// fixed size blocks made by OS_PoolCreate, the free ones are linked
+// through a pointer at the start of each
+struct OSPool{
+	void* FreeList;						// first free block, NULL if none
+	uint32_t BlockSize;				// bytes, a multiple of the pointer size
+	uint32_t NumBlocks;
+	Sema4Type BlocksFree;			// one count per free block, allocators wait on it
+	uint32_t InUse;
+	uint32_t HighWater;				// most blocks that were ever in use at once
+	uint32_t Failures;				// allocations that found no free block
+};
+typedef struct OSPool OSPoolType;
+
+// software timer made by OS_TimerCreate, all of them share one hardware timer
+struct OSTimer{
+	void(*Callback)(void);		// NULL while the timer is not in use
+	uint32_t Period;					// bus cycles
+	uint32_t Expiry;					// time it is due, bus cycles counting up with Timer1
+	int16_t HeapIndex;				// place in the expiry queue, -1 while stopped
+	uint8_t OneShot;					// 1 to stop after it fires once
+};
+typedef struct OSTimer OSTimerType;
+
+// EDF class thread made by OS_AddEDFThread
+// times are bus cycles counting up with Timer1, like software timer expiries
+struct OSEdf{
+	void(*Task)(void);				// job run to completion once per period
+	struct tcb* Thread;				// NULL until the thread first runs
+	uint32_t Period;
+	uint32_t RelDeadline;			// deadline of each job after its release
+	uint32_t Release;					// release time of the current job, or the next one while Waiting
+	uint32_t Deadline;				// absolute deadline of the current job
+	uint32_t Waiting;					// 1 between a job's completion and the next release
+	uint32_t Jobs;						// jobs completed
+	uint32_t Misses;					// jobs that completed after their deadline or were skipped
+	uint32_t MaxResponse;			// longest release to completion
+};
+typedef struct OSEdf OSEdfType;
+#define EDFPRI 0		// priority bin of the EDF class, ahead of the fixed priority threads
+
+// periodic interrupt load known to the response time analysis,
+// see OS_AdmitPeriodicThread and OS_AddISRLoad, times are bus cycles
+struct OSLoad{
+	void(*Task)(void);				// admitted periodic thread, NULL for a declared ISR
+	uint32_t Vector;					// exception number, VECTACTIVE while it runs
+	uint32_t Priority;				// NVIC priority, 0 is highest
+	uint32_t Period;					// shortest time between two runs
+	uint32_t Wcet;						// declared worst case execution time
+	uint32_t Measured;				// longest run seen by OS_ISRExit, preemption not counted
+	uint32_t Runs;
+};
+typedef struct OSLoad OSLoadType;
+
 struct tcb{
 	int32_t *sp;
 	struct tcb *next;
@@ -51,9 +206,30 @@ struct tcb{
 	Sema4Type* BlockedStatus;
 	int32_t Priority;
 	int32_t MemStatus;
+	int32_t SleepStatus;		// 1 while on the sleeping list
+	struct tcb *SlpNext;		// sleeping list links, separate so a timed wait can
+	struct tcb *SlpPrevious;	// be on a semaphore's blocked list at the same time
+	int32_t TimedOut;				// 1 if the last timed wait ran out before a signal
+	int32_t *StackBase;			// lowest address of the stack carved out of the stack pool
+	uint32_t StackSize;			// size of the stack in words
+	uint64_t RunTime;				// 12.5ns units spent running, updated by PendSV_Handler
+	uint32_t LastRun;				// Timer1 value when the thread was last switched in
+	uint32_t SwitchCount;		// number of times the thread has been switched in
+	uint32_t NotifyValue;		// count or bits sent by OS_NotifyGive/OS_NotifySetBits
+	int32_t NotifyWaiting;	// 1 while blocked in OS_NotifyTake
+	uint32_t EventMask;			// bits OS_EventWait is waiting for
+	uint32_t EventOptions;	// OS_EVENT_ALL, OS_EVENT_CLEAR of that wait
+	uint32_t EventBits;			// group's bits when OS_EventSet woke it
+	OSEdfType* EDF;					// NULL unless the thread is in the EDF class
+	int32_t BasePriority;		// priority it was created at, Priority is higher while it inherits one
+	struct Mutex* Held;			// mutexes it owns, their waiters set the priority it inherits
 };
+// offsets osasm.s uses for CPU time accounting, OS.c checks them at compile time
+#define TCB_RUNTIME 56
+#define TCB_LASTRUN 64
+#define TCB_SWITCHES 68
 
-extern Sema4Type LCDmutex;
+extern MutexType LCDmutex;
 
 // ******** OS_Init ************
 // initialize operating system, disable interrupts until OS_Launch
@@ -79,6 +255,20 @@ void OS_InitSemaphore(Sema4Type *semaPt, long value);
 // output: none
 void OS_Wait(Sema4Type *semaPt); 
 
+// status returned by the timed waits
+#define OS_SUCCESS 1		// got the semaphore or the data
+#define OS_TIMEOUT 0		// gave up, the timeout ran out first
+#define OS_FOREVER 0xFFFFFFFF		// timeout for OS_NotifyTake and OS_EventWait that never runs out
+
+// ******** OS_WaitTimeout ************
+// decrement semaphore, block for at most timeout if less than zero
+// the thread is on the semaphore's blocked list and the sleeping list,
+// whichever of OS_Signal and the timeout comes first takes it off the other
+// input:  pointer to a counting semaphore
+//         longest time to block, same units as OS_Sleep, 0 never blocks
+// output: OS_SUCCESS if the semaphore was taken, OS_TIMEOUT if not
+int OS_WaitTimeout(Sema4Type *semaPt, unsigned long timeout);
+
 // ******** OS_Signal ************
 // increment semaphore 
 // Lab2 spinlock
@@ -101,30 +291,157 @@ void OS_bWait(Sema4Type *semaPt);
 // output: none
 void OS_bSignal(Sema4Type *semaPt); 
 
+// ******** OS_InitMutex ************
+// initialize a priority inheritance mutex to free
+// input:  pointer to a mutex
+// output: none
+void OS_InitMutex(MutexType *mutexPt);
+
+// ******** OS_MutexLock ************
+// take the mutex, block if another thread owns it
+// the owner inherits the priority of the caller if it is higher
+// input:  pointer to a mutex
+// output: none
+// can not be called from an interrupt handler
+void OS_MutexLock(MutexType *mutexPt);
+
+// ******** OS_MutexUnlock ************
+// give the mutex to the highest priority waiting thread, or free it
+// the caller goes back to the priority it had when it took the mutex
+// input:  pointer to a mutex owned by the caller
+// output: none
+void OS_MutexUnlock(MutexType *mutexPt);
+
+// ******** OS_InitEventGroup ************
+// initialize an event group with every bit clear and no waiters
+// input:  pointer to an event group
+// output: none
+void OS_InitEventGroup(OSEventGroupType *groupPt);
+
+// ******** OS_EventSet ************
+// set bits in an event group and wake every waiter they satisfy in one
+// pass, may be called by an ISR
+// input:  pointer to an event group, bits to set
+// output: none
+void OS_EventSet(OSEventGroupType *groupPt, uint32_t mask);
+
+// ******** OS_EventClear ************
+// clear bits in an event group, may be called by an ISR
+// input:  pointer to an event group, bits to clear
+// output: none
+void OS_EventClear(OSEventGroupType *groupPt, uint32_t mask);
+
+// ******** OS_EventGet ************
+// input:  pointer to an event group
+// output: the bits that are set now
+uint32_t OS_EventGet(OSEventGroupType *groupPt);
+
+// ******** OS_EventWait ************
+// block until bits of an event group are set, any of them or all of them
+// input:  pointer to an event group, bits to wait for,
+//         OS_EVENT_ALL to wait for all of them instead of any,
+//         OS_EVENT_CLEAR to clear them when the wait is satisfied,
+//         timeout in ms, 0 never blocks, OS_FOREVER never times out
+// output: the group's bits when the wait was satisfied, 0 if the timeout ran out
+uint32_t OS_EventWait(OSEventGroupType *groupPt, uint32_t mask, uint32_t options, unsigned long timeout);
+
+// Interrupt priority bands
+// StartCritical/EndCritical, used by every kernel critical section, raise
+// BASEPRI to OS_KERNELPRI instead of setting PRIMASK, so they only hold off
+// interrupts of priority OS_KERNELPRI to 7. Priorities 0 to OS_KERNELPRI-1
+// are the zero-latency band, the kernel never delays them, but their handlers
+// must not call any OS_ function or TRACE, since no critical section keeps
+// them out. Periodic threads, switch tasks, software timers and any ISR
+// that signals a thread need a priority of OS_KERNELPRI or more.
+#define OS_KERNELPRI 1		// change KERNELBASEPRI in osasm.s with it
+
 //******** OS_AddThread *************** 
 // add a foregound thread to the scheduler
 // Inputs: pointer to a void/void foreground task
 //         number of bytes allocated for its stack
-//         priority, 0 is highest, 5 is the lowest
+//         priority, 1 is highest, 5 is the lowest, 0 is EDFPRI and is
+//           rejected, every thread in that bin runs behind the EDF jobs,
+//           use OS_AddEDFThread
 // Outputs: 1 if successful, 0 if this thread can not be added
-// stack size must be divisable by 8 (aligned to double word boundary)
-// In Lab 2, you can ignore both the stackSize and priority fields
-// In Lab 3, you can ignore the stackSize fields
+// stack size is rounded up to a multiple of 8 bytes (aligned to double word boundary)
+// stacks come from a shared pool and are given back by OS_Kill
+// a thread that uses floating point needs 136 more bytes for the FPU registers
 int OS_AddThread(void(*task)(void), 
    unsigned long stackSize, unsigned long priority);
 
+// ******** OS_StackPoolFree ************
+// words free in the shared stack pool, including the stack of a killed
+// thread that the next OS_AddThread will reclaim
+// Inputs:  none
+// Outputs: free words
+unsigned long OS_StackPoolFree(void);
+
+//******** OS_AddEDFThread *************** 
+// add a periodic thread to the earliest deadline first class
+// EDF threads run ahead of every fixed priority thread, the one with the
+// earliest absolute deadline first, fixed priority threads should use
+// priorities above EDFPRI
+// Inputs: job, a void/void function run to completion once per period,
+//           it may block but not kill itself
+//         number of bytes allocated for its stack
+//         period in us, 1 to 26000000
+//         relative deadline in us, 1 to period
+// Outputs: 1 if successful, 0 if all NUMEDF are in use, the times are out
+//          of range or the thread can not be added
+// The first job is released when the thread first runs. A job that is a
+// whole period late skips the releases it missed, each counts as a miss.
+int OS_AddEDFThread(void(*task)(void), unsigned long stackSize,
+	unsigned long period_us, unsigned long deadline_us);
+
+//******** OS_EDFReport *************** 
+// print period, deadline, jobs, deadline misses and the longest response
+// time of every EDF thread
+// Inputs: none
+// Outputs: none
+void OS_EDFReport(void);
+
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
 // Inputs: none
 // Outputs: Thread ID, number greater than zero 
 unsigned long OS_Id(void);
 
+//******** OS_Self *************** 
+// returns the TCB of the currently running thread, the handle the
+// OS_Notify functions send to
+// Inputs: none
+// Outputs: TCB of the running thread
+tcbType* OS_Self(void);
+
+//******** OS_NotifyGive *************** 
+// add one to a thread's notification value and wake it if it is in
+// OS_NotifyTake, a lighter semaphore for one ISR or thread waking one
+// known thread, may be called by an ISR
+// Inputs: thread to notify, from OS_Self
+// Outputs: none
+void OS_NotifyGive(tcbType* thread);
+
+//******** OS_NotifySetBits *************** 
+// OR bits into a thread's notification value and wake it if it is in
+// OS_NotifyTake, may be called by an ISR
+// Inputs: thread to notify, bits to set
+// Outputs: none
+void OS_NotifySetBits(tcbType* thread, uint32_t mask);
+
+//******** OS_NotifyTake *************** 
+// wait until the running thread's notification value is not zero,
+// then return it and clear it
+// Inputs: timeout in ms, 0 never blocks, OS_FOREVER never times out
+// Outputs: the count or bits received, 0 if the timeout ran out first
+uint32_t OS_NotifyTake(unsigned long timeout);
+
 //******** OS_AddPeriodicThread *************** 
 // add a background periodic task
 // typically this function receives the highest priority
 // Inputs: pointer to a void/void background function
 //         period given in system time units (12.5ns)
 //         priority 0 is the highest, 5 is the lowest
+//           OS_KERNELPRI or more if the task calls the OS
 // Outputs: 1 if successful, 0 if this thread can not be added
 // You are free to select the time resolution for this function
 // It is assumed that the user task will run to completion and return
@@ -139,6 +456,112 @@ unsigned long OS_Id(void);
 int OS_AddPeriodicThread(void(*task)(void), int timer, 
    unsigned long period, unsigned long priority);
 
+//******** OS_AdmitPeriodicThread *************** 
+// add a background periodic task if the response time analysis shows every
+// periodic interrupt load, this one included, still finishes within its period
+// Inputs: pointer to a void/void background function, same rules as OS_AddPeriodicThread
+//         timer 0,1 or 4 to 9 (Timer0A to Timer4B, Timer1 is the OS clock)
+//         period in us, 13 to 1000000
+//         worst case execution time in us
+//         NVIC priority OS_KERNELPRI to 6, 0 is the highest
+// Outputs: 1 if admitted and started, 0 if rejected, the reason is printed
+// The analysis uses the larger of the declared and the measured execution
+// time of each load, OS_RtaReport shows both. Time with interrupts
+// disabled is not included.
+int OS_AdmitPeriodicThread(void(*task)(void), int timer, unsigned long period_us,
+	unsigned long wcet_us, unsigned long priority);
+
+//******** OS_AddISRLoad *************** 
+// tell the response time analysis about an interrupt that is not a periodic
+// thread, like the ADC, UART or software timers
+// Inputs: exception number (interrupt number + 16)
+//         shortest time between two interrupts in us
+//         worst case execution time in us
+//         its NVIC priority, 0 is the highest
+// Outputs: 1 if the periodic loads stay schedulable, 0 if rejected, the
+//          reason is printed and the load is not recorded
+// A handler that calls OS_ISREnter first and OS_ISRExit last has its
+// execution time measured.
+int OS_AddISRLoad(unsigned long vector, unsigned long period_us,
+	unsigned long wcet_us, unsigned long priority);
+
+//******** OS_ISREnter *************** 
+// start measuring the execution time of the interrupt handler that is running
+// Inputs: none
+// Outputs: none
+void OS_ISREnter(void);
+
+//******** OS_ISRExit *************** 
+// stop measuring, the time less any nested interrupts is the handler's
+// measured execution time if it is longer than any seen before
+// Inputs: none
+// Outputs: none
+void OS_ISRExit(void);
+
+//******** OS_RtaHeadroom *************** 
+// CPU time the periodic interrupt loads leave for threads
+// Inputs: none
+// Outputs: tenths of a percent, 0 if they need all of it
+unsigned long OS_RtaHeadroom(void);
+
+//******** OS_RtaReport *************** 
+// print the response time analysis of every periodic interrupt load with
+// declared and measured execution times, and the headroom left for threads
+// Inputs: none
+// Outputs: none
+void OS_RtaReport(void);
+
+//******** OS_TimerCreate *************** 
+// add a software timer, periodic or one-shot, and start it
+// every software timer runs off Wide Timer 0A, so it takes no GPTM or NVIC
+// priority of its own, the callbacks run in that interrupt one after another
+// Inputs: pointer to a void/void background function, same rules as OS_AddPeriodicThread
+//         period in us, 1 to 26000000
+//         1 for a one-shot timer, 0 for a periodic one
+// Outputs: handle for OS_TimerStart/Stop/Delete, NULL if the period is out of
+//          range or all NUMSWTIMERS are in use
+OSTimerType* OS_TimerCreate(void(*callback)(void), unsigned long period_us, int oneShot);
+
+//******** OS_TimerStart *************** 
+// (re)start a software timer, it fires one period from now
+// Inputs: timer
+// Outputs: none
+void OS_TimerStart(OSTimerType* timer);
+
+//******** OS_TimerStop *************** 
+// stop a software timer, it can be started again
+// Inputs: timer
+// Outputs: none
+void OS_TimerStop(OSTimerType* timer);
+
+//******** OS_TimerDelete *************** 
+// stop a software timer and give it back
+// Inputs: timer
+// Outputs: none
+void OS_TimerDelete(OSTimerType* timer);
+
+//******** OS_AddWorker *************** 
+// create the worker thread that runs deferred work at one priority
+// Inputs: priority of the worker, 1 is highest, EDFPRI is rejected like in OS_AddThread
+// Outputs: 1 if successful or there already is a worker at that priority,
+//          0 if all NUMWORKERS are in use or the thread can not be added
+int OS_AddWorker(unsigned long priority);
+
+//******** OS_WorkPost *************** 
+// hand a function to the worker thread at a priority, O(1) and safe to
+// call from an ISR, the function runs later in that thread's context
+// so it may block or sleep, items behind it wait until it returns
+// Inputs: function, argument passed to it, priority of the worker to run it
+// Outputs: 1 if queued, 0 if there is no worker at that priority or its
+//          queue is full
+int OS_WorkPost(void(*function)(uint32_t), uint32_t arg, unsigned long priority);
+
+//******** OS_WorkReport *************** 
+// print priority, high water mark and overflows of every work queue
+// Inputs: none
+// Outputs: none
+void OS_WorkReport(void);
+
 //******** OS_AddSwitchTasks *************** 
 // add a background task to run whenever the SW1 (PF4) button is pushed
 // Inputs: pointer to a void/void background function
@@ -206,6 +629,7 @@ void OS_Suspend(int PriChange);
 // In Lab 3, you can put whatever restrictions you want on size
 //    e.g., 4 to 64 elements
 //    e.g., must be a power of 2,4,8,16,32,64,128
+// size is rounded down to a power of 2 and limited to 128
 void OS_Fifo_Init(unsigned long size);
 
 // ******** OS_Fifo_Put ************
@@ -223,6 +647,7 @@ int OS_Fifo_Put(unsigned long data);
 // Called in foreground, will spin/block if empty
 // Inputs:  none
 // Outputs: data 
+// Only one thread may call it, the Fifo is single producer, single consumer
 unsigned long OS_Fifo_Get(void);
 
 // ******** OS_Fifo_Size ************
@@ -234,6 +659,135 @@ unsigned long OS_Fifo_Get(void);
 //          zero or less than zero if a call to OS_Fifo_Get will spin or block
 long OS_Fifo_Size(void);
 
+// ******** OS_Fifo_PutBlock ************
+// Enter up to n data samples into the Fifo, never waits
+// Inputs:  samples, number of samples
+// Outputs: number saved, the rest did not fit
+unsigned long OS_Fifo_PutBlock(const unsigned long* src, unsigned long n);
+
+// ******** OS_Fifo_GetBlock ************
+// Remove up to maxN data samples from the Fifo
+// Blocks until at least minN are in it, so the consumer is woken once per batch
+// Inputs:  where to put the samples, most to take, fewest to wait for
+// Outputs: number of samples removed, at least minN
+unsigned long OS_Fifo_GetBlock(unsigned long* dst, unsigned long maxN, unsigned long minN);
+
+// ******** OS_Fifo_GetTimeout ************
+// Remove one data sample from the Fifo, block for at most timeout if empty
+// Inputs:  where to put the sample, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if nothing came in time
+int OS_Fifo_GetTimeout(unsigned long* data, unsigned long timeout);
+
+// ******** OS_FifoCreate ************
+// Make a new Fifo in a buffer supplied by the caller
+// Inputs:  buffer of size*elemSize bytes, aligned for the element type
+//          number of entries, must be a power of 2
+//          bytes per entry
+// Outputs: handle for the other OS_Fifo functions, NULL if size is not
+//          a power of 2 or all NUMFIFOS have been created
+OSFifoType* OS_FifoCreate(void* buffer, unsigned long size, unsigned long elemSize);
+
+// ******** OS_FifoPut ************
+// Copy one entry into a Fifo, never waits, may be called by an ISR
+// Inputs:  Fifo, pointer to elemSize bytes of data
+// Outputs: 1 if saved, 0 if the Fifo was full (counted in Overflows)
+int OS_FifoPut(OSFifoType* fifo, const void* data);
+
+// ******** OS_FifoGet ************
+// Copy the oldest entry out of a Fifo, blocks while it is empty
+// Only one thread may get from a given Fifo
+// Inputs:  Fifo, where to put elemSize bytes of data
+// Outputs: none
+void OS_FifoGet(OSFifoType* fifo, void* data);
+
+// ******** OS_FifoPutBlock ************
+// Copy up to n entries into a Fifo, never waits, may be called by an ISR
+// Inputs:  Fifo, n entries of elemSize bytes each, number of entries
+// Outputs: number saved, the ones that did not fit are counted in Overflows
+unsigned long OS_FifoPutBlock(OSFifoType* fifo, const void* src, unsigned long n);
+
+// ******** OS_FifoGetBlock ************
+// Copy up to maxN of the oldest entries out of a Fifo
+// Blocks until at least minN entries are in it, the producer only wakes the
+// consumer once that many are there (minN is limited to the Fifo size)
+// Only one thread may get from a given Fifo
+// Inputs:  Fifo, room for maxN entries, most to take, fewest to wait for
+// Outputs: number of entries copied
+unsigned long OS_FifoGetBlock(OSFifoType* fifo, void* dst, unsigned long maxN, unsigned long minN);
+
+// ******** OS_FifoGetTimeout ************
+// Copy the oldest entry out of a Fifo, block for at most timeout if empty
+// Only one thread may get from a given Fifo
+// Inputs:  Fifo, where to put elemSize bytes of data, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if nothing came in time
+int OS_FifoGetTimeout(OSFifoType* fifo, void* data, unsigned long timeout);
+
+// ******** OS_FifoGetBlockTimeout ************
+// OS_FifoGetBlock that blocks for at most timeout waiting for minN entries
+// Inputs:  Fifo, room for maxN entries, most to take, fewest to wait for,
+//          timeout in OS_Sleep units
+// Outputs: number of entries copied, fewer than minN (maybe 0) on a timeout
+unsigned long OS_FifoGetBlockTimeout(OSFifoType* fifo, void* dst, unsigned long maxN,
+	unsigned long minN, unsigned long timeout);
+
+// ******** OS_FifoSize ************
+// Inputs:  Fifo
+// Outputs: number of entries in it
+long OS_FifoSize(OSFifoType* fifo);
+
+// ******** OS_FifoStats ************
+// Capacity planning counters of a Fifo
+// Inputs:  Fifo, where to return the high water mark and the overflow count
+// Outputs: none
+void OS_FifoStats(OSFifoType* fifo, unsigned long* highWater, unsigned long* overflows);
+
+// ******** OS_FifoReport ************
+// print size, entries, high water mark and overflows of every Fifo
+// Inputs:  none
+// Outputs: none
+void OS_FifoReport(void);
+
+// ******** OS_PoolCreate ************
+// Make a pool of fixed size blocks in a buffer supplied by the caller
+// Inputs:  buffer of numBlocks*blockSize bytes, aligned for a pointer
+//          bytes per block, rounded up to a multiple of the pointer size
+//            so every free block can hold the free list link
+//          number of blocks
+// Outputs: handle for the other OS_Pool functions, NULL if the sizes are
+//          0, the buffer is misaligned or all NUMPOOLS have been created
+OSPoolType* OS_PoolCreate(void* buffer, unsigned long blockSize, unsigned long numBlocks);
+
+// ******** OS_PoolAlloc ************
+// Take a block from a pool, never waits, may be called by an ISR
+// Inputs:  pool
+// Outputs: the block, NULL if none was free (counted in Failures)
+void* OS_PoolAlloc(OSPoolType* pool);
+
+// ******** OS_PoolAllocTimeout ************
+// Take a block from a pool, block for at most timeout if none is free
+// Inputs:  pool, timeout in ms, 0 never waits
+// Outputs: the block, NULL if none was freed in time
+void* OS_PoolAllocTimeout(OSPoolType* pool, unsigned long timeout);
+
+// ******** OS_PoolFree ************
+// Give a block back to the pool it came from, may be called by an ISR
+// Inputs:  pool, block from OS_PoolAlloc or OS_PoolAllocTimeout
+// Outputs: none
+void OS_PoolFree(OSPoolType* pool, void* block);
+
+// ******** OS_PoolStats ************
+// Capacity planning counters of a pool
+// Inputs:  pool, where to return the blocks in use, the most ever in use
+//          at once, and the allocations that found the pool empty
+// Outputs: none
+void OS_PoolStats(OSPoolType* pool, unsigned long* inUse, unsigned long* highWater, unsigned long* failures);
+
+// ******** OS_PoolReport ************
+// print block size, blocks, in use, high water mark and failures of every pool
+// Inputs:  none
+// Outputs: none
+void OS_PoolReport(void);
+
 // ******** OS_MailBox_Init ************
 // Initialize communication channel
 // Inputs:  none
@@ -256,6 +810,12 @@ void OS_MailBox_Send(unsigned long data);
 // It will spin/block if the MailBox is empty 
 unsigned long OS_MailBox_Recv(void);
 
+// ******** OS_MailBox_RecvTimeout ************
+// remove mail from the MailBox, block for at most timeout if it is empty
+// Inputs:  where to put the data, timeout in OS_Sleep units
+// Outputs: OS_SUCCESS, or OS_TIMEOUT if no mail came in time
+int OS_MailBox_RecvTimeout(unsigned long* data, unsigned long timeout);
+
 // ******** OS_Time ************
 // return the system time 
 // Inputs:  none
@@ -272,8 +832,18 @@ unsigned long OS_Time(void);
 // The time resolution should be less than or equal to 1us, and the precision at least 12 bits
 // It is ok to change the resolution and precision of this function as long as 
 //   this function and OS_Time have the same resolution and precision 
+// Correct across a rollover as long as stop is less than 53.7 s after start,
+// use OS_Time64 for longer intervals
 unsigned long OS_TimeDifference(unsigned long start, unsigned long stop);
 
+// ******** OS_Time64 ************
+// monotonic system time, Timer1 extended with a count of its rollovers
+// Inputs:  none
+// Outputs: 12.5ns units since OS_Init, counts up
+// Can be called from threads and ISRs, SysTick reads it often enough
+// that no rollover is missed
+uint64_t OS_Time64(void);
+
 // ******** OS_ClearMsTime ************
 // sets the system time to zero (from Lab 1)
 // Inputs:  none
@@ -284,7 +854,7 @@ void OS_ClearMsTime(void);
 // ******** OS_MsTime ************
 // reads the current time in msec (from Lab 1)
 // Inputs:  none
-// Outputs: time in ms units
+// Outputs: time in ms units since OS_ClearMsTime, from OS_Time64
 // You are free to select the time resolution for this function
 // It is ok to make the resolution to match the first call to OS_AddPeriodicThread
 unsigned long OS_MsTime(void);
@@ -299,8 +869,25 @@ unsigned long OS_MsTime(void);
 // It is ok to limit the range of theTimeSlice to match the 24-bit SysTick
 void OS_Launch(unsigned long theTimeSlice);
 
+//******** OS_LaunchTickless *************** 
+// start the scheduler with SysTick stretched to the next wakeup
+// whenever the running thread has nothing to round-robin with
+// Inputs: number of 12.5ns clock cycles for each time slice
+// Outputs: none (does not return)
+// sleep times and OS_MsTime come from OS_Time64, so they are not affected
+// the idle thread should execute WFI (WaitForInterrupt)
+void OS_LaunchTickless(unsigned long theTimeSlice);
+
 void Jitter(void);
 
+//******** OS_ThreadStats *************** 
+// print CPU usage of every live thread
+// ID, priority, percent of the CPU time used by live threads,
+// number of times switched in and ms since it was last switched in
+// Inputs: none
+// Outputs: none
+void OS_ThreadStats(void);
+
 void OS_ResetSysTick(void);
 
 #endif
@@ -2,6 +2,9 @@
 
 #include "TIMER.h"
 #include "tm4c123gh6pm.h"
+#ifdef HOSTSIM
+#include "sim.h"
+#endif
 
 
 void(*HandlerTaskArray[12])(void); // Holds the function pointers to the threads that will be launched
@@ -12,6 +15,7 @@ volatile unsigned int* timerCtrlBuf[12] = {TIMER0_CTL_PTR_R, TIMER0_CTL_PTR_R, T
 
 static int usedTimers[12];
 static int timerCount = -1;	
+static void(*OneShotTask)(void);		// runs when Wide Timer 0A expires
 
 
 void TIMER_ClearPeriodicTime(int timer)
@@ -541,6 +545,47 @@ void TIMER_NVIC_DisableTimerInt(int timer)
 	}
 }																							
 
+// Wide Timer 0A in 32-bit one-shot mode, the one hardware timer
+// behind the OS software timers (OS_TimerCreate)
+// configure it and the NVIC, task runs in WideTimer0A_Handler each time it expires
+void TIMER_OneShotInit(void(*task)(void), unsigned long priority)
+{
+	int delay;
+	SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R0;   // activate wide timer0
+	delay = SYSCTL_RCGCWTIMER_R;   // allow time to finish activating
+	WTIMER0_CTL_R &= ~TIMER_CTL_TAEN; // disable WideTimerA0
+	WTIMER0_CFG_R = TIMER_CFG_16_BIT; // on a wide timer this is the 32-bit individual configuration
+	WTIMER0_TAMR_R = TIMER_TAMR_TAMR_1_SHOT; // count down once, TAEN clears itself at the timeout
+	WTIMER0_TAPR_R = 0; // set prescale = 0
+	WTIMER0_ICR_R = TIMER_ICR_TATOCINT; // clear timeout flag
+	WTIMER0_IMR_R |= TIMER_IMR_TATOIM; // arm the timeout interrupt
+	NVIC_PRI23_R = (NVIC_PRI23_R & ~NVIC_PRI23_INTC_M)|(priority << NVIC_PRI23_INTC_S); // interrupt 94
+	OneShotTask = task;
+	NVIC_EN2_R = NVIC_EN2_INT94;
+}
+
+// (re)start it to expire once after the given number of bus cycles
+void TIMER_OneShotStart(unsigned long cycles)
+{
+	WTIMER0_CTL_R &= ~TIMER_CTL_TAEN; // stop it, a new TAILR only loads on enable
+	WTIMER0_TAILR_R = cycles-1;
+	WTIMER0_ICR_R = TIMER_ICR_TATOCINT; // an old timeout is stale now
+	WTIMER0_CTL_R |= TIMER_CTL_TAEN;
+}
+
+// stop it before it expires
+void TIMER_OneShotStop(void)
+{
+	WTIMER0_CTL_R &= ~TIMER_CTL_TAEN;
+	WTIMER0_ICR_R = TIMER_ICR_TATOCINT;
+}
+
+void WideTimer0A_Handler(void)
+{
+	WTIMER0_ICR_R = TIMER_ICR_TATOCINT; // acknowledge interrupt flag
+	(*OneShotTask)(); // run the software timers that are due
+}
+
 void Timer0A_Handler(void)
 {
 	TIMER0_ICR_R = TIMER_ICR_TATOCINT; // acknowledge interrupt flag
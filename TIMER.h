@@ -48,3 +48,14 @@ void TIMER_NVIC_EnableTimerInt(int timer);
 // it requires setting the appropriate bits in the EN Registers
 void TIMER_NVIC_DisableTimerInt(int timer);
 
+// Wide Timer 0A in 32-bit one-shot mode, the one hardware timer
+// behind the OS software timers (OS_TimerCreate)
+// configure it and the NVIC, task runs in WideTimer0A_Handler each time it expires
+void TIMER_OneShotInit(void(*task)(void), unsigned long priority);
+
+// (re)start it to expire once after the given number of bus cycles
+void TIMER_OneShotStart(unsigned long cycles);
+
+// stop it before it expires
+void TIMER_OneShotStop(void);
+
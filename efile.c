@@ -18,6 +18,18 @@ unsigned char tempDir[BLOCKSIZE];
 int endOfFileIndex;
 uint8_t buf[BLOCKSIZE]; 
 
+//Globals used by the write-back cache (Write, WClose, Sync)
+//LastWBlock, the FAT block being appended to and the directory stay in RAM
+//and only go to the disk when the tail block fills or on WClose/Sync
+int LastWIndex;											//index of the first free byte in LastWBlock
+int LastWDirty = 0;									//LastWBlock has bytes that are not on the disk yet
+int WDirDirty = 0;									//tempDir has free list/end block changes not on the disk yet
+unsigned char WFATBuf[BLOCKSIZE];
+uint16_t WFATBlockNum = 0;					//FAT block held in WFATBuf, 0 if none (block 0 is the directory)
+int WFATDirty = 0;
+unsigned long WCacheHits = 0;				//bytes appended without touching the disk
+unsigned long WCacheFlushes = 0;		//blocks written back to the disk by the cache
+
 //Globals used by File Reading operations (ROpen, Read)
 unsigned char LastRBlock[BLOCKSIZE];
 uint16_t LastRBlockNum;
@@ -57,6 +69,40 @@ int RedirectFlag = 0;
 		Step 3: BlockNumber + SizeOfFAT = Corresponding Block in File
 		*/
 
+//---------- eFile_FlushData-----------------
+// Write the cached last data block back if it is dirty
+// Input: none
+// Output: 0 if successful and 1 on failure
+static int eFile_FlushData(void){
+	int status = 0;
+	if(LastWDirty){
+		status |= eDisk_WriteBlock(LastWBlock,LastWBlockNum);
+		WCacheFlushes++;
+		LastWDirty = 0;
+	}
+	return status;
+}
+
+//---------- eFile_LoadFAT-----------------
+// Bring a FAT block into WFATBuf, writing back the one it replaces
+// The data block goes first, so a FAT entry never reaches the disk
+// linking a block whose data is still only in RAM
+// Input: FAT block number (FATSTART to FATEND)
+// Output: 0 if successful and 1 on failure
+static int eFile_LoadFAT(uint16_t FATBlock){
+	int status = 0;
+	if(WFATBlockNum==FATBlock) return 0;
+	if(WFATDirty){
+		status |= eFile_FlushData();
+		status |= eDisk_WriteBlock(WFATBuf,WFATBlockNum);
+		WCacheFlushes++;
+		WFATDirty = 0;
+	}
+	status |= eDisk_ReadBlock(WFATBuf,FATBlock);
+	WFATBlockNum = FATBlock;
+	return status;
+}
+
 //---------- eFile_Init-----------------
 // Activate the file system, without formating
 // Input: none
@@ -78,6 +124,12 @@ int eFile_Format(void){
 	int i,j,k;
 	int status = 0;
 	
+	//everything cached is about to be erased
+	LastWDirty = 0;
+	WDirDirty = 0;
+	WFATDirty = 0;
+	WFATBlockNum = 0;
+	
 	/**********Format the Directory**********/
 	strcpy(dir[FREE].name,"FREE");   //First directory entry is "FREE"
 	dir[FREE].startFAT = 1; // FAT index corresponding to the start of the file space
@@ -161,6 +213,8 @@ int eFile_Create( char name[]){  // create new file, make it empty
 	int FATBlock, FATIndex, nextBlock;
 	int status = 0;
 
+	status |= eFile_Sync();		//directory and FAT on the disk must be current
+	WFATBlockNum = 0;					//the FAT block is modified below through buf
 	status |= eDisk_ReadBlock(tempDir,DIRECTBLOCK);
 	for(i = 0; i < BLOCKSIZE; i += DIRENTRYSIZE)
 	{
@@ -173,7 +227,7 @@ int eFile_Create( char name[]){  // create new file, make it empty
 	if(i==BLOCKSIZE) status = 1; //no more room in directory;
 	
 	//Free space starts with startBlock
-	startBlock = (tempDir[8]<<8) + tempDir[9]&0xFF;
+	startBlock = ((tempDir[8]<<8)|tempDir[9]);
 	
 	// startblock of file in directory
 	tempDir[i+NAMESIZE] = startBlock >> 8; // store high byte
@@ -187,7 +241,7 @@ int eFile_Create( char name[]){  // create new file, make it empty
 	FATIndex = startBlock%256*2;				//Index within FAT Block that contains the second block of the Free List. 
 	FATBlock = startBlock/256+1;			//Block # for corresponding FAT block
 	status |= eDisk_ReadBlock(buf,FATBlock);	//Read the FAT block
-	nextBlock = (buf[FATIndex]<<8) + buf[FATIndex+1]&0xFF;		//Get the next Block in the Free List
+	nextBlock = ((buf[FATIndex]<<8)|buf[FATIndex+1]);		//Get the next Block in the Free List
 	buf[FATIndex] = 0;				//Set the contents of that block equal to null (the file contains only one block)
 	buf[FATIndex+1] = 0;
 	status |= eDisk_WriteBlock(buf,FATBlock);
@@ -213,6 +267,7 @@ uint16_t eFile_WOpen(char name[]){      // open a file for writing
 	int i;
 	uint16_t startBlock, endBlock, status = 0;
 	FileWName = name;
+	status |= eFile_Sync();
 	status |= eDisk_ReadBlock(tempDir,DIRECTBLOCK);
 	
 	// search directory for matching file char
@@ -229,64 +284,101 @@ uint16_t eFile_WOpen(char name[]){      // open a file for writing
 	endBlock = (tempDir[endBlock]<<8) + tempDir[endBlock+1];
 	LastWBlockNum = endBlock+FATSIZE;
 	status |= eDisk_ReadBlock(LastWBlock,endBlock+FATSIZE);
+	for(LastWIndex=0; LastWIndex<BLOCKSIZE; LastWIndex++){		//find the first free byte once, Write appends from there
+		if(LastWBlock[LastWIndex]==0xFF) break;
+	}
+	LastWDirty = 0;
 	
 	return status; // block on the filesystem that was written to most recently for this file
 }
 
 //---------- eFile_Write-----------------
 // save at end of the open file
+// The byte goes into the RAM copy of the last block, the disk is only
+// written when that block fills up (or on eFile_WClose/eFile_Sync)
 // Input: data to be saved
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Write( char data){
-	int startBlock,i,j;
+	int startBlock;
 	int FATBlock, FATIndex, nextBlock;
 	int FATPrevBlk, FATPrevIndex;
 	int endFreeBlock;
 	int status = 0;
-	status |= eDisk_ReadBlock(LastWBlock,LastWBlockNum);
-	for(j=0; j<512; j++){
-		if(LastWBlock[j]==0xFF){
-			LastWBlock[j]=data;
-			status |= eDisk_WriteBlock(LastWBlock,LastWBlockNum);
-			break;
-		}
-	}  
-	if(j==512){
-		status |= eDisk_WriteBlock(LastWBlock,LastWBlockNum);
-		startBlock = (tempDir[8]<<8) + tempDir[9]&0xFF;  //start of free space
-		endFreeBlock = (tempDir[10]<<8) + tempDir[11]&0xFF;  //start of free space
-		if(startBlock==endFreeBlock) return 1;
-		FATPrevBlk = (LastWBlockNum-FATSIZE)/256+1;
-		FATPrevIndex = (LastWBlockNum-FATSIZE)%256*2;
-		// need to change startBlock of Free to be FAT[startBlock] to point to next available block
-		FATIndex = startBlock%256*2;				//Index within FAT Block that contains the second block of the Free List. 
-		FATBlock = startBlock/256+1;			//Block # for corresponding FAT block
-		status |= eDisk_ReadBlock(buf,FATBlock);	//Read the FAT block
-		nextBlock = (buf[FATIndex]<<8) + buf[FATIndex+1]&0xFF;		//Get the next Block in the Free List
-		buf[FATIndex] = 0;				//Set the contents of that block equal to null (the file contains only one block)
-		buf[FATIndex+1] = 0;
-		buf[FATPrevIndex] = startBlock>>8;
-		buf[FATPrevIndex+1] = startBlock&0xFF;
-		status |= eDisk_WriteBlock(buf,FATBlock);
-		tempDir[NAMESIZE] = nextBlock >> 8; //Update directory for free list
-		tempDir[NAMESIZE+1] = nextBlock & 0xFF;
-		// endblock in directory
-		tempDir[endOfFileIndex] = startBlock >> 8; // store high byte
-		tempDir[endOfFileIndex+1] = startBlock & 0x00FF; // store low byte
+	if(LastWIndex<BLOCKSIZE){
+		LastWBlock[LastWIndex++]=data;
+		LastWDirty = 1;
+		WCacheHits++;
+		return 0;
+	}
+	//last block is full, write it back and link a new block from the free list
+	status |= eFile_FlushData();
+	startBlock = ((tempDir[8]<<8)|tempDir[9]);  //start of free space
+	endFreeBlock = ((tempDir[10]<<8)|tempDir[11]);  //end of free space
+	if(startBlock==endFreeBlock) return 1;
+	FATPrevBlk = (LastWBlockNum-FATSIZE)/256+1;
+	FATPrevIndex = (LastWBlockNum-FATSIZE)%256*2;
+	// need to change startBlock of Free to be FAT[startBlock] to point to next available block
+	FATIndex = startBlock%256*2;				//Index within FAT Block that contains the second block of the Free List. 
+	FATBlock = startBlock/256+1;			//Block # for corresponding FAT block
+	status |= eFile_LoadFAT(FATBlock);
+	nextBlock = ((WFATBuf[FATIndex]<<8)|WFATBuf[FATIndex+1]);		//Get the next Block in the Free List
+	WFATBuf[FATIndex] = 0;				//new block is the end of the file
+	WFATBuf[FATIndex+1] = 0;
+	WFATDirty = 1;
+	status |= eFile_LoadFAT(FATPrevBlk);	//old end of the file may live in a different FAT block
+	WFATBuf[FATPrevIndex] = startBlock>>8;
+	WFATBuf[FATPrevIndex+1] = startBlock&0xFF;
+	WFATDirty = 1;
+	tempDir[NAMESIZE] = nextBlock >> 8; //Update directory for free list
+	tempDir[NAMESIZE+1] = nextBlock & 0xFF;
+	// endblock in directory
+	tempDir[endOfFileIndex] = startBlock >> 8; // store high byte
+	tempDir[endOfFileIndex+1] = startBlock & 0x00FF; // store low byte
+	WDirDirty = 1;
+	
+	//new last block starts out erased with the data as its first byte
+	LastWBlock[0] = data;
+	for(LastWIndex=1; LastWIndex<BLOCKSIZE; LastWIndex++){
+		LastWBlock[LastWIndex]=0xFF;
+	}
+	LastWIndex = 1;
+	LastWBlockNum = startBlock+FATSIZE;
+	LastWDirty = 1;
+	return status;
+}
+
+//---------- eFile_Sync-----------------
+// write every dirty cached block back to the disk
+// Data, then FAT, then directory, the same order eFile_LoadFAT keeps, so
+// no FAT entry on the disk links a block whose data was never written
+// Input: none
+// Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
+int eFile_Sync(void){
+	int status = 0;
+	status |= eFile_FlushData();
+	if(WFATDirty){
+		status |= eDisk_WriteBlock(WFATBuf,WFATBlockNum);
+		WCacheFlushes++;
+		WFATDirty = 0;
+	}
+	if(WDirDirty){
 		status |= eDisk_WriteBlock(tempDir,DIRECTBLOCK);
-		
-		//Write zeroes to the first block in the new file
-		buf[0] = data;
-		for(i=1; i<BLOCKSIZE; i++){
-			buf[i]=0xFF;
-		}
-		status |= eDisk_WriteBlock(buf,startBlock+FATSIZE);
-		LastWBlockNum = startBlock+FATSIZE;
-		
-	}  
+		WCacheFlushes++;
+		WDirDirty = 0;
+	}
 	return status;
 }
 
+//---------- eFile_CacheStats-----------------
+// report the write-back cache counters
+// Input: pointers to hold the number of bytes appended in RAM and
+//        the number of blocks written back to the disk
+// Output: none
+void eFile_CacheStats(unsigned long *hits, unsigned long *flushes){
+	*hits = WCacheHits;
+	*flushes = WCacheFlushes;
+}
+
 //---------- eFile_Close-----------------
 // Deactivate the file system
 // Input: none
@@ -301,8 +393,7 @@ int eFile_Close(void){
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_WClose(void){
-	int status = 0;
-	status |= eDisk_WriteBlock(LastWBlock,LastWBlockNum);
+	return eFile_Sync();
 } // close the file for writing
 
 //---------- eFile_ROpen-----------------
@@ -313,6 +404,7 @@ int eFile_ROpen( char name[]){
 	int i,status=0;
 	uint16_t startBlock, endBlock;
 	FileRName = name;
+	status |= eFile_Sync();			//file may still be open for writing
 	status |= eDisk_ReadBlock(tempDirRead,DIRECTBLOCK);
 	
 	// search directory for matching file char
@@ -339,24 +431,24 @@ int eFile_ROpen( char name[]){
 //         0 if successful and 1 on failure (e.g., end of file)
 int eFile_ReadNext( char *pt){
 	int lastBlock,FATIndex,nextBlock,FATBlock,status=0;
-	if(LastRBlock[ReadingPos]==0xFF){
-		return 1;
-	}else{
-		*pt = LastRBlock[ReadingPos++];
-	}  
-	if(ReadingPos==512){
+	if(ReadingPos==BLOCKSIZE){		//move to the next block only when a byte from it is wanted
 		lastBlock = LastRBlockNum - FATSIZE;
 		FATBlock = lastBlock/256+1;
 		FATIndex = (lastBlock%256)*2;
 		status |= eDisk_ReadBlock(FATReadBuf,FATBlock);
-		nextBlock = (FATReadBuf[FATIndex]<<8) + FATReadBuf[FATIndex+1]&0xFF;		//Get the next Block in the file
+		nextBlock = ((FATReadBuf[FATIndex]<<8)|FATReadBuf[FATIndex+1]);		//Get the next Block in the file
 		if(nextBlock!=0){
 			status |= eDisk_ReadBlock(LastRBlock,nextBlock+FATSIZE);
 		}
 		else return 1;
-		//LastRBlockNum = nextBlock + FATSIZE;
+		LastRBlockNum = nextBlock + FATSIZE;		//the FAT entry of this block links to the one after it
 		ReadingPos=0;
 	}
+	if(LastRBlock[ReadingPos]==0xFF){
+		return 1;
+	}else{
+		*pt = LastRBlock[ReadingPos++];
+	}  
 	return status;
 }       // get next byte 
                               
@@ -366,6 +458,7 @@ int eFile_ReadNext( char *pt){
 // Output: 0 if successful and 1 on failure (e.g., wasn't open)
 int eFile_RClose(void){
 	ReadingPos = 0;
+	return 0;
 } // close the file for writing
 
 //---------- eFile_Directory-----------------
@@ -377,6 +470,7 @@ int eFile_Directory(void(*fp)(unsigned char)){
 			int i,j,status=0;
 			char name[8];
 			unsigned char startBlockHi,startBlockLo, endBlockHi,endBlockLo;
+			status |= eFile_Sync();
 			status |= eDisk_ReadBlock(tempDirRead,DIRECTBLOCK);  
 			for(i = 0; i < BLOCKSIZE; i += DIRENTRYSIZE)
 			{
@@ -404,14 +498,16 @@ int eFile_Delete( char name[]){
 	 //attach attach front of file to end of FREE list
 	 //FAT[EndofFree]=startofFile
 	//EndofFree = EndofFile
+	 status |= eFile_Sync();
+	 WFATBlockNum = 0;				//the FAT block is modified below through buf
 	 status |= eDisk_ReadBlock(tempDir,DIRECTBLOCK);
-	 EndOfFreeBlk= (tempDir[NAMESIZE+2]<<8) + tempDir[NAMESIZE+3]&0xFF;  //start of free space
+	 EndOfFreeBlk= ((tempDir[NAMESIZE+2]<<8)|tempDir[NAMESIZE+3]);  //start of free space
 	 for(i = 0; i < BLOCKSIZE; i += DIRENTRYSIZE)
 	{
 		if(!strcmp(name,&tempDirRead[i]))
 		{
-			StartOfFileBlck = (tempDir[(i + NAMESIZE)]<<8)+tempDir[(i+NAMESIZE+1)]&0xFF;
-			EndOfFileBlck = (tempDir[(i + NAMESIZE+2)]<<8)+tempDir[(i+NAMESIZE+3)]&0xFF;
+			StartOfFileBlck = ((tempDir[(i + NAMESIZE)]<<8)|tempDir[(i+NAMESIZE+1)]);
+			EndOfFileBlck = ((tempDir[(i + NAMESIZE+2)]<<8)|tempDir[(i+NAMESIZE+3)]);
 			break;
 		}
 	}
@@ -64,6 +64,19 @@ uint16_t eFile_WOpenFront(char name[], uint8_t* buf);
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Write( char data);  
 
+//---------- eFile_Sync-----------------
+// write every dirty cached block back to the disk
+// Input: none
+// Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
+int eFile_Sync(void);
+
+//---------- eFile_CacheStats-----------------
+// report the write-back cache counters
+// Input: pointers to hold the number of bytes appended in RAM and
+//        the number of blocks written back to the disk
+// Output: none
+void eFile_CacheStats(unsigned long *hits, unsigned long *flushes);
+
 //---------- eFile_Close-----------------
 // Deactivate the file system
 // Input: none
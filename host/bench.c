@@ -0,0 +1,812 @@
+// bench.c
+// Kernel benchmarks for the hosted simulation, see sim.h for the build line
+// Each run launches the real OS once, so pick one benchmark per run:
+//   rtosbench sema [seconds]          semaphore ping-pong between two threads
+//   rtosbench fpu [fpthreads] [seconds]
+//                                     sema ping-pong with 0, 1 or 2 of the two threads
+//                                     using the FPU, cycles per context switch
+//                                     (the difference against a -DNOACCOUNTING build
+//                                     is the cost of the CPU time accounting)
+//   rtosbench lock [seconds]          OS_Wait/OS_Signal pairs on a free semaphore,
+//                                     the uncontended fast path
+//   rtosbench wake [rate] [seconds] [sema|notify]
+//                                     interrupt at rate Hz waking one thread with
+//                                     OS_Signal or OS_NotifyGive, wake latency
+//   rtosbench events [rate] [seconds] event group with one thread waiting for any of two
+//                                     bits, one for all of two, and four woken together
+//                                     by a pulse, interrupts set the bits
+//   rtosbench fifo [rate] [seconds] [batch]
+//                                     interrupt producer at rate Hz into OS_FifoPut,
+//                                     consumer thread on OS_FifoGet, or on
+//                                     OS_FifoGetBlock woken once per batch samples
+//   rtosbench timers [count] [seconds] count periodic software timers of 1 to 10 ms
+//                                     plus a 1 ms probe timer whose jitter is measured
+//   rtosbench edf [load] [seconds]    three EDF threads of 1, 5 and 10 ms period sharing
+//                                     load percent of the CPU, a fixed priority thread
+//                                     gets the rest, deadline misses and response times
+//   rtosbench rta [seconds]           four interrupt loads admitted by response time
+//                                     analysis, one rejected first, measured against
+//                                     declared execution times
+//   rtosbench jitter [priority] [seconds]
+//                                     1 kHz sampling interrupt at priority (0, the
+//                                     zero-latency band, by default) against thread
+//                                     ping-pong and a 20 us kernel critical section
+//                                     (built with -DPROFILER, the worst masking call sites)
+//   rtosbench file [bytes]            eFile write then read back of one file, 128 KB by default
+//                                     so the block numbers use both FAT bytes
+//   rtosbench mutex                   a priority 3 thread boosted through one mutex takes a
+//                                     second and unlocks them out of order, it has to
+//                                     end up back at priority 3
+//   rtosbench stacks [threads]        OS_AddThread/OS_Kill cycles with stacks that leave
+//                                     less than the minimum in the pool, the free
+//                                     words must come back to where they started
+//   rtosbench timeout [seconds]       OS_WaitTimeout racing a 30 ms signal interrupt,
+//                                     with a second thread in a plain OS_Wait
+//   rtosbench pool [rate] [seconds]   interrupt at rate Hz filling 512 byte blocks from
+//                                     OS_PoolAlloc, only the pointers go through a Fifo
+//   rtosbench work [rate] [seconds]   interrupt at rate Hz posting to a worker with
+//                                     OS_WorkPost, latency until the item runs, every
+//                                     tenth also posts to a lower priority worker
+// Times are simulated, so results repeat exactly from run to run.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "OS.h"
+#include "efile.h"
+#include "sim.h"
+
+#define TIMESLICE (2*TIME_1MS)
+#define WORKCYCLES 400				// processing charged per item in the consumers
+void WaitForInterrupt(void);		// in sim.c, startup.s on the board
+int32_t StartCritical(void);			// in sim.c, osasm.s on the board
+void EndCritical(int32_t status);
+
+static unsigned long Count = 0;		// items moved by the benchmark
+static unsigned long Lost = 0;
+static unsigned long MaxLatency = 0;
+static uint64_t SumLatency = 0;
+static Sema4Type Ping, Pong;
+
+static void Idle(void){
+	while(1){
+		WaitForInterrupt();
+	}
+}
+
+//************ sema ************
+static void Pinger(void){
+	while(1){
+		OS_Signal(&Ping);
+		OS_Wait(&Pong);
+		Count++;
+	}
+}
+static void Ponger(void){
+	while(1){
+		OS_Wait(&Ping);
+		OS_Signal(&Pong);
+	}
+}
+
+static unsigned long FPThreads = 0;
+static void FPPinger(void){
+	if(FPThreads > 0){
+		Sim_UseFPU();
+	}
+	Pinger();
+}
+static void FPPonger(void){
+	if(FPThreads > 1){
+		Sim_UseFPU();
+	}
+	Ponger();
+}
+
+static void Locker(void){
+	while(1){
+		OS_Wait(&Ping);
+		OS_Signal(&Ping);
+		Count++;
+	}
+}
+
+//************ wake ************
+static int UseNotify = 1;
+static tcbType* Woken;				// OS_Self of the woken thread
+static unsigned long WakeStamp;		// Timer1 value when the interrupt woke it
+static void Waker(void){
+	WakeStamp = OS_Time();
+	if(UseNotify){
+		OS_NotifyGive(Woken);
+	}else{
+		OS_Signal(&Ping);
+	}
+}
+static void WakeLatency(void){
+	unsigned long latency = OS_TimeDifference(WakeStamp, OS_Time());
+	SumLatency += latency;
+	if(latency > MaxLatency){
+		MaxLatency = latency;
+	}
+	Count++;
+}
+static void NotifyWaiter(void){
+	Woken = OS_Self();
+	while(1){
+		OS_NotifyTake(OS_FOREVER);
+		WakeLatency();
+	}
+}
+static void SemaWaiter(void){
+	while(1){
+		OS_Wait(&Ping);
+		WakeLatency();
+	}
+}
+
+//************ events ************
+#define EVDATA 0x01				// set at rate Hz
+#define EVBUTTON 0x02			// set at rate/7 Hz
+#define EVHALF 0x04				// set at rate/3 Hz
+#define EVPULSE 0x08			// set and cleared again at rate/10 Hz
+#define PULSEWAITERS 4
+static OSEventGroupType Events;
+static unsigned long AnyCount = 0, AllCount = 0, PulseCount = 0, Pulses = 0, Sets[3];
+static void SetData(void){
+	Sets[0]++;
+	WakeStamp = OS_Time();
+	OS_EventSet(&Events, EVDATA);
+}
+static void SetButton(void){
+	Sets[1]++;
+	OS_EventSet(&Events, EVBUTTON);
+}
+static void SetHalf(void){
+	Sets[2]++;
+	OS_EventSet(&Events, EVHALF|EVDATA);
+}
+static void Pulse(void){
+	Pulses++;
+	OS_EventSet(&Events, EVPULSE);		// wakes every pulse waiter in one pass
+	OS_EventClear(&Events, EVPULSE);
+}
+static void AnyWaiter(void){
+	while(1){
+		if(OS_EventWait(&Events, EVDATA|EVBUTTON, OS_EVENT_CLEAR, OS_FOREVER) & EVDATA){
+			WakeLatency();
+		}
+		AnyCount++;
+	}
+}
+static void AllWaiter(void){
+	while(1){
+		OS_EventWait(&Events, EVBUTTON|EVHALF, OS_EVENT_ALL|OS_EVENT_CLEAR, OS_FOREVER);
+		AllCount++;
+	}
+}
+static void PulseWaiter(void){
+	while(1){
+		if(OS_EventWait(&Events, EVPULSE, 0, OS_FOREVER) & EVPULSE){
+			PulseCount++;
+		}
+	}
+}
+
+//************ fifo ************
+// each sample is the Timer1 value when it was produced
+#define BENCHFIFOSIZE 64
+static unsigned long BenchBuf[BENCHFIFOSIZE];
+static OSFifoType* BenchFifo;
+static uint64_t SumPut = 0;			// cycles spent in OS_FifoPut
+static void Producer(void){
+	uint64_t start = SimTime;
+	unsigned long sample = OS_Time();
+	if(OS_FifoPut(BenchFifo, &sample) == 0){
+		Lost++;
+	}
+	SumPut += SimTime - start;
+}
+static unsigned long Batch = 1;		// samples per consumer wakeup
+static void Consume(unsigned long sample){
+	unsigned long latency = OS_TimeDifference(sample, OS_Time());
+	SumLatency += latency;
+	if(latency > MaxLatency){
+		MaxLatency = latency;
+	}
+	Count++;
+	Sim_Burn(WORKCYCLES);
+}
+static void Consumer(void){
+	unsigned long sample;
+	while(1){
+		OS_FifoGet(BenchFifo, &sample);
+		Consume(sample);
+	}
+}
+static void BatchConsumer(void){
+	unsigned long samples[BENCHFIFOSIZE];
+	unsigned long i, n;
+	while(1){
+		n = OS_FifoGetBlock(BenchFifo, samples, Batch, Batch);
+		for(i=0; i<n; i++){
+			Consume(samples[i]);
+		}
+	}
+}
+
+//************ timeout ************
+#define WAITTIMEOUT 20				// ms
+static unsigned long Signals = 0, Timeouts = 0, PlainCount = 0;
+static uint64_t SumTimeout = 0, MaxTimeout = 0;
+static void Signaler(void){
+	Signals++;
+	OS_Signal(&Ping);
+}
+static void TimedWaiter(void){
+	uint64_t start, waited;
+	while(1){
+		start = SimTime;
+		if(OS_WaitTimeout(&Ping, WAITTIMEOUT) == OS_TIMEOUT){
+			waited = SimTime - start;
+			SumTimeout += waited;
+			if(waited > MaxTimeout){
+				MaxTimeout = waited;
+			}
+			Timeouts++;
+		}else{
+			Count++;
+		}
+	}
+}
+static void PlainWaiter(void){
+	while(1){
+		OS_Wait(&Ping);
+		PlainCount++;
+		OS_Sleep(2*WAITTIMEOUT);		// leaves the timed waiter alone on the semaphore now and then
+	}
+}
+
+//************ pool ************
+// each block starts with the Timer1 value when it was filled
+#define POOLBLOCKS 8
+#define BLOCKSAMPLES 128			// 512 bytes
+static unsigned long PoolBuf[POOLBLOCKS*BLOCKSAMPLES];
+static OSPoolType* BenchPool;
+static unsigned long* PtrBuf[POOLBLOCKS];
+static void BlockProducer(void){
+	uint64_t start = SimTime;
+	unsigned long* block = OS_PoolAlloc(BenchPool);
+	if(block == NULL){
+		Lost++;
+	}else{
+		block[0] = OS_Time();
+		OS_FifoPut(BenchFifo, &block);		// never full, it holds every block of the pool
+	}
+	SumPut += SimTime - start;
+}
+static void BlockConsumer(void){
+	unsigned long* block;
+	while(1){
+		OS_FifoGet(BenchFifo, &block);
+		Consume(block[0]);
+		OS_PoolFree(BenchPool, block);
+	}
+}
+
+//************ work ************
+// arg is the Timer1 value when the item was posted
+// a priority 3 worker is added before the priority 1 one, each item checks
+// it ran on the worker it was posted to
+#define LOWWORKPRI 3
+static unsigned long LowItems = 0, Misrouted = 0, Posts = 0;
+static void WorkItem(uint32_t arg){
+	if(OS_Self()->Priority != 1){
+		Misrouted++;
+	}
+	Consume(arg);
+}
+static void LowWorkItem(uint32_t arg){		// arg is the priority it was posted to
+	if(OS_Self()->Priority != (int32_t)arg){
+		Misrouted++;
+	}
+	LowItems++;
+}
+static void Poster(void){
+	if(OS_WorkPost(&WorkItem, OS_Time(), 1) == 0){
+		Lost++;
+	}
+	if(((++Posts)%10 == 0) && (OS_WorkPost(&LowWorkItem, LOWWORKPRI, LOWWORKPRI) == 0)){
+		Lost++;
+	}
+}
+
+//************ timers ************
+#define PROBEUS 1000
+static unsigned long NumTimers = 200, Expected = 0, Ticks = 0, ProbeCount = 0;
+static uint64_t ProbeLast = 0, ProbeJitter = 0;
+static void TimerTick(void){
+	Ticks++;
+}
+static void Probe(void){
+	uint64_t err;
+	if(ProbeCount++){
+		err = SimTime - ProbeLast;
+		err = (err > PROBEUS*(SIMBUSFREQ/1000000)) ? err - PROBEUS*(SIMBUSFREQ/1000000) : PROBEUS*(SIMBUSFREQ/1000000) - err;
+		if(err > ProbeJitter){
+			ProbeJitter = err;
+		}
+	}
+	ProbeLast = SimTime;
+}
+
+//************ edf ************
+#define EDFTASKS 3
+static const unsigned long EDFPeriod[EDFTASKS] = {1000, 5000, 10000};		// us
+static const unsigned long EDFDeadline[EDFTASKS] = {800, 5000, 10000};
+static const unsigned long EDFStack[EDFTASKS] = {1024, 512, 256};		// bytes, each job checks it got its own
+static unsigned long EDFLoad = 90;		// percent of the CPU the EDF jobs need
+static unsigned long Background = 0;
+static unsigned long WrongStack = 0;		// jobs that ran on a thread made for another job
+// each job takes an equal share of the load over its own period
+#define EDFJOB(k) do{ \
+		if(OS_Self()->StackSize*4 != EDFStack[k]){ \
+			WrongStack++; \
+		} \
+		Sim_Burn((uint32_t)((uint64_t)EDFPeriod[k]*(SIMBUSFREQ/1000000)*EDFLoad/(100*EDFTASKS))); \
+	}while(0)
+static void FastJob(void){
+	EDFJOB(0);
+}
+static void MidJob(void){
+	EDFJOB(1);
+}
+static void SlowJob(void){
+	EDFJOB(2);
+}
+static void BackgroundWork(void){
+	while(1){
+		Sim_Burn(WORKCYCLES);
+		Background++;
+	}
+}
+
+//************ rta ************
+#define US (SIMBUSFREQ/1000000)
+static void LoadFast(void){		// 100 us, priority 1
+	OS_ISREnter();
+	Sim_Burn(20*US);
+	OS_ISRExit();
+}
+static void LoadMid(void){		// 1 ms, priority 2, runs longer than declared
+	OS_ISREnter();
+	Sim_Burn(200*US);
+	OS_ISRExit();
+}
+static void LoadSlow(void){		// 5 ms, priority 3, preempted by the other two
+	OS_ISREnter();
+	Sim_Burn(1000*US);
+	OS_ISRExit();
+}
+static void LoadLow(void){		// 2 ms, priority 4
+	OS_ISREnter();
+	Sim_Burn(300*US);
+	OS_ISRExit();
+}
+
+//************ jitter ************
+#define SAMPLEPERIOD (SIMBUSFREQ/1000)
+#define SCANCYCLES (20*US)			// kernel critical section, like a long wake scan
+static uint64_t SampleStart;			// SimTime when the sampling interrupt was added
+static uint32_t MinLatency = 0xFFFFFFFF;
+static unsigned long Samples = 0;
+static void Sampler(void){		// no OS calls, it may be in the zero-latency band
+	uint32_t latency = (SimTime - SampleStart)%SAMPLEPERIOD;
+	Samples++;
+	SumLatency += latency;
+	if(latency > MaxLatency){
+		MaxLatency = latency;
+	}
+	if(latency < MinLatency){
+		MinLatency = latency;
+	}
+}
+static void KernelScan(void){
+	int32_t status;
+	status = StartCritical();
+	Sim_Burn(SCANCYCLES);
+	EndCritical(status);
+}
+
+//************ mutex ************
+static MutexType MutexA, MutexB;
+static long BoostedTo = -1, Restored = -1;
+static void MutexHigh(void){		// priority 1
+	OS_Sleep(1);								// let the low thread take MutexA first
+	OS_MutexLock(&MutexA);
+	Count++;
+	OS_MutexUnlock(&MutexA);
+	OS_Kill();
+}
+static void MutexLow(void){		// priority 3
+	OS_MutexLock(&MutexA);
+	Sim_Burn(2*(SIMBUSFREQ/1000));	// MutexHigh blocks on MutexA meanwhile
+	BoostedTo = OS_Self()->Priority;
+	OS_MutexLock(&MutexB);			// taken while it inherits priority 1
+	OS_MutexUnlock(&MutexA);
+	OS_MutexUnlock(&MutexB);
+	Restored = OS_Self()->Priority;
+	Sim_StopAfter(0);
+	OS_Kill();
+}
+
+//************ stacks ************
+#define STACKSLACK 128				// words, twice MINSTACKSIZE in OS.c, so half the children take a whole block
+static unsigned long Spawns = 1000, AddFailures = 0, PoolBefore, PoolAfter;
+static void Child(void){
+	OS_Signal(&Ping);
+	OS_Kill();
+}
+static void Spawner(void){
+	unsigned long i;
+	PoolBefore = OS_StackPoolFree();
+	for(i=0; i<Spawns; i++){
+		if(OS_AddThread(&Child, 4*(PoolBefore - 2*(i%(STACKSLACK/2))), 1) == 0){
+			AddFailures++;
+			continue;
+		}
+		OS_Wait(&Ping);
+		Count++;
+	}
+	PoolAfter = OS_StackPoolFree();
+	Sim_StopAfter(0);
+	OS_Kill();
+}
+
+//************ file ************
+static unsigned long FileBytes;
+static uint64_t WriteTime, ReadTime;
+static int FileErrors = 0;
+#define FILEDATA(I) ((char)('a' + (I)%26))		// 0xFF marks unused bytes in eFile, keep it out of the data
+static void FileTest(void){
+	unsigned long i;
+	uint64_t start;
+	char data;
+	FileErrors += eFile_Init();
+	FileErrors += eFile_Format();
+	FileErrors += eFile_Create("bench");
+	start = SimTime;
+	FileErrors += (eFile_WOpen("bench") != 0);
+	for(i=0; i<FileBytes; i++){
+		FileErrors += eFile_Write(FILEDATA(i));
+	}
+	FileErrors += eFile_WClose();
+	WriteTime = SimTime - start;
+	start = SimTime;
+	FileErrors += eFile_ROpen("bench");
+	for(i=0; i<FileBytes; i++){
+		if(eFile_ReadNext(&data) || (data != FILEDATA(i))){
+			FileErrors++;
+			break;
+		}
+		Count++;
+	}
+	FileErrors += eFile_RClose();
+	ReadTime = SimTime - start;
+	Sim_StopAfter(0);
+	OS_Kill();
+}
+
+int main(int argc, char** argv){
+	const char* which = (argc > 1) ? argv[1] : "sema";
+	double seconds = 1.0;
+	unsigned long rate = 10000;
+	clock_t wall;
+	unsigned long highWater, overflows;
+
+	OS_Init();
+	OS_AddThread(&Idle, 256, 7);
+	if(strcmp(which, "sema") == 0){
+		if(argc > 2){
+			seconds = atof(argv[2]);
+		}
+		OS_InitSemaphore(&Ping, 0);
+		OS_InitSemaphore(&Pong, 0);
+		OS_AddThread(&Pinger, 256, 1);
+		OS_AddThread(&Ponger, 256, 1);
+	}else if(strcmp(which, "fpu") == 0){
+		if(argc > 2){
+			FPThreads = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		OS_InitSemaphore(&Ping, 0);
+		OS_InitSemaphore(&Pong, 0);
+		OS_AddThread(&FPPinger, 256, 1);
+		OS_AddThread(&FPPonger, 256, 1);
+	}else if(strcmp(which, "lock") == 0){
+		if(argc > 2){
+			seconds = atof(argv[2]);
+		}
+		OS_InitSemaphore(&Ping, 1);
+		OS_AddThread(&Locker, 256, 1);
+	}else if(strcmp(which, "wake") == 0){
+		if(argc > 2){
+			rate = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		UseNotify = (argc <= 4) || (strcmp(argv[4], "sema") != 0);
+		OS_InitSemaphore(&Ping, 0);
+		OS_AddThread(UseNotify ? &NotifyWaiter : &SemaWaiter, 256, 1);
+		Sim_AddInterrupt(&Waker, SIMBUSFREQ/rate, 2);
+	}else if(strcmp(which, "events") == 0){
+		int i;
+		if(argc > 2){
+			rate = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		OS_InitEventGroup(&Events);
+		OS_AddThread(&AnyWaiter, 256, 1);
+		OS_AddThread(&AllWaiter, 256, 1);
+		for(i=0; i<PULSEWAITERS; i++){
+			OS_AddThread(&PulseWaiter, 256, 2);
+		}
+		Sim_AddInterrupt(&SetData, SIMBUSFREQ/rate, 2);
+		Sim_AddInterrupt(&SetButton, 7*(SIMBUSFREQ/rate), 2);
+		Sim_AddInterrupt(&SetHalf, 3*(SIMBUSFREQ/rate), 2);
+		Sim_AddInterrupt(&Pulse, 10*(SIMBUSFREQ/rate), 3);
+	}else if(strcmp(which, "fifo") == 0){
+		if(argc > 2){
+			rate = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		if(argc > 4){
+			Batch = strtoul(argv[4], NULL, 0);
+		}
+		if((Batch == 0) || (Batch > BENCHFIFOSIZE)){
+			printf("batch must be 1 to %d\n", BENCHFIFOSIZE);
+			return 1;
+		}
+		BenchFifo = OS_FifoCreate(BenchBuf, BENCHFIFOSIZE, sizeof(unsigned long));
+		OS_AddThread((Batch > 1) ? &BatchConsumer : &Consumer, 256, 1);
+		Sim_AddInterrupt(&Producer, SIMBUSFREQ/rate, 2);		// ADC sample interrupt
+	}else if(strcmp(which, "timeout") == 0){
+		if(argc > 2){
+			seconds = atof(argv[2]);
+		}
+		OS_InitSemaphore(&Ping, 0);
+		OS_AddThread(&TimedWaiter, 256, 2);
+		OS_AddThread(&PlainWaiter, 256, 1);
+		Sim_AddInterrupt(&Signaler, 30*(SIMBUSFREQ/1000), 2);
+	}else if(strcmp(which, "pool") == 0){
+		if(argc > 2){
+			rate = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		BenchPool = OS_PoolCreate(PoolBuf, BLOCKSAMPLES*sizeof(unsigned long), POOLBLOCKS);
+		BenchFifo = OS_FifoCreate(PtrBuf, POOLBLOCKS, sizeof(unsigned long*));
+		OS_AddThread(&BlockConsumer, 256, 1);
+		Sim_AddInterrupt(&BlockProducer, SIMBUSFREQ/rate, 2);
+	}else if(strcmp(which, "work") == 0){
+		if(argc > 2){
+			rate = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		if((OS_AddWorker(LOWWORKPRI) == 0) || (OS_AddWorker(1) == 0)){		// low first, the high one runs first
+			printf("no worker\n");
+			return 1;
+		}
+		Sim_AddInterrupt(&Poster, SIMBUSFREQ/rate, 2);		// GPIO edge interrupt
+	}else if(strcmp(which, "timers") == 0){
+		unsigned long i, period;
+		if(argc > 2){
+			NumTimers = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		for(i=0; i<NumTimers; i++){
+			period = 1000 + (i*9001)%9000;		// spread over 1 to 10 ms
+			if(OS_TimerCreate(&TimerTick, period, 0) == NULL){
+				printf("only %lu timers could be created\n", i);
+				return 1;
+			}
+			Expected += (unsigned long)(seconds*1000000.0/period);
+		}
+		if(OS_TimerCreate(&Probe, PROBEUS, 0) == NULL){
+			printf("no timer left for the probe\n");
+			return 1;
+		}
+		OS_AddThread(&Pinger, 256, 1);		// a thread load for the timer interrupt to preempt
+		OS_AddThread(&Ponger, 256, 1);
+		OS_InitSemaphore(&Ping, 0);
+		OS_InitSemaphore(&Pong, 0);
+	}else if(strcmp(which, "edf") == 0){
+		static void(* const job[EDFTASKS])(void) = {&FastJob, &MidJob, &SlowJob};
+		int i;
+		if(argc > 2){
+			EDFLoad = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		for(i=0; i<EDFTASKS; i++){
+			if(OS_AddEDFThread(job[i], EDFStack[i], EDFPeriod[i], EDFDeadline[i]) == 0){
+				printf("EDF thread %d not added\n", i);
+				return 1;
+			}
+		}
+		OS_AddThread(&BackgroundWork, 256, 1);
+	}else if(strcmp(which, "rta") == 0){
+		if(argc > 2){
+			seconds = atof(argv[2]);
+		}
+		OS_AddISRLoad(SIMIRQVECTOR+0, 100, 20, 1);
+		OS_AddISRLoad(SIMIRQVECTOR+1, 1000, 150, 2);
+		OS_AddISRLoad(SIMIRQVECTOR+2, 5000, 1000, 3);
+		if(OS_AddISRLoad(SIMIRQVECTOR+3, 2000, 900, 4)){
+			printf("a 900 us load every 2 ms should not fit\n");
+			return 1;
+		}
+		if(OS_AddISRLoad(SIMIRQVECTOR+3, 2000, 300, 4) == 0){
+			printf("a 300 us load every 2 ms should fit\n");
+			return 1;
+		}
+		printf("predicted headroom %lu.%lu%%\n", OS_RtaHeadroom()/10, OS_RtaHeadroom()%10);
+		Sim_AddInterrupt(&LoadFast, 100*US, 1);
+		Sim_AddInterrupt(&LoadMid, 1000*US, 2);
+		Sim_AddInterrupt(&LoadSlow, 5000*US, 3);
+		Sim_AddInterrupt(&LoadLow, 2000*US, 4);
+		OS_AddThread(&BackgroundWork, 256, 1);
+	}else if(strcmp(which, "jitter") == 0){
+		unsigned long priority = 0;
+		if(argc > 2){
+			priority = strtoul(argv[2], NULL, 0);
+		}
+		if(argc > 3){
+			seconds = atof(argv[3]);
+		}
+		OS_InitSemaphore(&Ping, 0);
+		OS_InitSemaphore(&Pong, 0);
+		OS_AddThread(&Pinger, 256, 1);
+		OS_AddThread(&Ponger, 256, 1);
+		SampleStart = SimTime;
+		Sim_AddInterrupt(&Sampler, SAMPLEPERIOD, priority);
+		Sim_AddInterrupt(&KernelScan, SIMBUSFREQ/700, OS_KERNELPRI+1);
+	}else if(strcmp(which, "file") == 0){
+		FileBytes = (argc > 2) ? strtoul(argv[2], NULL, 0) : 131072;		// 256 blocks, block numbers need both FAT bytes
+		seconds = 1000.0;		// FileTest stops the run when it is done
+		OS_AddThread(&FileTest, 512, 1);
+	}else if(strcmp(which, "mutex") == 0){
+		seconds = 1.0;		// MutexLow stops the run when it is done
+		OS_InitMutex(&MutexA);
+		OS_InitMutex(&MutexB);
+		OS_AddThread(&MutexHigh, 256, 1);
+		OS_AddThread(&MutexLow, 256, 3);
+	}else if(strcmp(which, "stacks") == 0){
+		if(argc > 2){
+			Spawns = strtoul(argv[2], NULL, 0);
+		}
+		seconds = 1000.0;		// Spawner stops the run when it is done
+		OS_InitSemaphore(&Ping, 0);
+		OS_AddThread(&Spawner, 256, 1);
+	}else{
+		printf("usage: %s sema [seconds] | fpu [fpthreads] [seconds] | lock [seconds] | wake [rate] [seconds] [sema|notify] | events [rate] [seconds] | fifo [rate] [seconds] [batch] | timeout [seconds] | pool [rate] [seconds] | work [rate] [seconds] | timers [count] [seconds] | edf [load] [seconds] | rta [seconds] | jitter [priority] [seconds] | file [bytes] | mutex | stacks [threads]\n", argv[0]);
+		return 1;
+	}
+	Sim_StopAfter((uint64_t)(seconds*SIMBUSFREQ));
+	wall = clock();
+	OS_Launch(TIMESLICE);
+	wall = clock() - wall;
+
+	printf("%s: %.3f s simulated in %.3f s host time\n", which,
+		(double)SimTime/SIMBUSFREQ, (double)wall/CLOCKS_PER_SEC);
+	printf("context switches %lu\n", SimSwitches);
+	if(strcmp(which, "sema") == 0){
+		printf("round trips %lu, %.0f per second, %.1f cycles each\n", Count,
+			Count/((double)SimTime/SIMBUSFREQ), Count ? (double)SimTime/Count : 0.0);
+	}else if(strcmp(which, "fpu") == 0){
+		printf("FPU threads %lu, round trips %lu, %.1f cycles each, %.1f cycles per switch\n", FPThreads, Count,
+			Count ? (double)SimTime/Count : 0.0, SimSwitches ? (double)SimTime/SimSwitches : 0.0);
+	}else if(strcmp(which, "lock") == 0){
+		printf("wait/signal pairs %lu, %.1f cycles each\n", Count, Count ? (double)SimTime/Count : 0.0);
+	}else if(strcmp(which, "wake") == 0){
+		printf("%s wakeups %lu, latency cycles avg %.1f max %lu\n", UseNotify ? "notify" : "sema", Count,
+			Count ? (double)SumLatency/Count : 0.0, MaxLatency);
+		printf("RAM per wait object %lu bytes (%s)\n", UseNotify ? (unsigned long)(sizeof(Woken->NotifyValue)+sizeof(Woken->NotifyWaiting))
+			: (unsigned long)sizeof(Sema4Type), UseNotify ? "in the TCB" : "Sema4Type");
+	}else if(strcmp(which, "events") == 0){
+		printf("data sets %lu, button sets %lu, half sets %lu, pulses %lu\n", Sets[0], Sets[1], Sets[2], Pulses);
+		printf("any waiter %lu wakeups, data latency cycles avg %.1f max %lu\n", AnyCount,
+			Count ? (double)SumLatency/Count : 0.0, MaxLatency);
+		printf("all waiter %lu wakeups, pulse waiters %lu wakeups of %lu\n", AllCount, PulseCount,
+			Pulses*PULSEWAITERS);
+	}else if(strcmp(which, "fifo") == 0){
+		printf("batch %lu, samples %lu, %.0f per second, lost %lu (isr %lu)\n", Batch, Count,
+			Count/((double)SimTime/SIMBUSFREQ), Lost, SimIrqLost[0]);
+		printf("switches per sample %.3f, put cycles avg %.1f\n", Count ? (double)SimSwitches/Count : 0.0,
+			(double)SumPut/(Count+Lost));
+		printf("latency cycles avg %.1f max %lu\n", Count ? (double)SumLatency/Count : 0.0, MaxLatency);
+		OS_FifoStats(BenchFifo, &highWater, &overflows);
+		printf("fifo high water %lu of %d, overflows %lu\n", highWater, BENCHFIFOSIZE, overflows);
+	}else if(strcmp(which, "pool") == 0){
+		printf("blocks %lu, %.0f per second, lost %lu, alloc+put cycles avg %.1f\n", Count,
+			Count/((double)SimTime/SIMBUSFREQ), Lost, (double)SumPut/(Count+Lost));
+		printf("latency cycles avg %.1f max %lu\n", Count ? (double)SumLatency/Count : 0.0, MaxLatency);
+		OS_PoolReport();
+	}else if(strcmp(which, "work") == 0){
+		printf("items %lu, %.0f per second, lost %lu\n", Count, Count/((double)SimTime/SIMBUSFREQ), Lost);
+		printf("switches per item %.3f, latency cycles avg %.1f max %lu\n", Count ? (double)SimSwitches/Count : 0.0,
+			Count ? (double)SumLatency/Count : 0.0, MaxLatency);
+		printf("priority %d items %lu, items run on the wrong worker %lu\n", LOWWORKPRI, LowItems, Misrouted);
+		OS_WorkReport();
+		if(Misrouted){
+			printf("FAILED, a worker took another priority's queue\n");
+			return 1;
+		}
+	}else if(strcmp(which, "timers") == 0){
+		printf("timers %lu, callbacks %lu of %lu expected, %.0f per second\n", NumTimers, Ticks, Expected,
+			Ticks/((double)SimTime/SIMBUSFREQ));
+		printf("probe %lu callbacks, period jitter max %.3f us\n", ProbeCount,
+			ProbeJitter/(double)(SIMBUSFREQ/1000000));
+	}else if(strcmp(which, "timeout") == 0){
+		printf("signals %lu, taken by timed wait %lu, plain wait %lu, semaphore %ld\n",
+			Signals, Count, PlainCount, Ping.Value);
+		printf("timeouts %lu, waited avg %.3f ms max %.3f ms for %.3f ms\n", Timeouts,
+			Timeouts ? SumTimeout*1000.0/SIMBUSFREQ/Timeouts : 0.0, MaxTimeout*1000.0/SIMBUSFREQ,
+			(double)WAITTIMEOUT);
+	}else if(strcmp(which, "edf") == 0){
+		printf("load %lu%%, background work %.1f%% of the CPU\n", EDFLoad,
+			100.0*Background*WORKCYCLES/SimTime);
+		OS_EDFReport();
+		if(WrongStack){
+			printf("FAILED, %lu jobs ran on another job's thread\n", WrongStack);
+			return 1;
+		}
+	}else if(strcmp(which, "jitter") == 0){
+		printf("samples %lu, latency cycles avg %.1f min %u max %lu, jitter %.3f us\n", Samples,
+			Samples ? (double)SumLatency/Samples : 0.0, MinLatency, MaxLatency,
+			(double)(MaxLatency-MinLatency)/(SIMBUSFREQ/1000000));
+#ifdef PROFILER
+		OS_CritReport(5);
+#endif
+	}else if(strcmp(which, "rta") == 0){
+		printf("background work %.1f%% of the CPU, interrupts lost %lu %lu %lu %lu\n",
+			100.0*Background*WORKCYCLES/SimTime, SimIrqLost[0], SimIrqLost[1], SimIrqLost[2], SimIrqLost[3]);
+		OS_RtaReport();
+	}else if(strcmp(which, "mutex") == 0){
+		printf("high thread took the mutex %lu times, low thread boosted to %ld, back at %ld\n",
+			Count, BoostedTo, Restored);
+		if((Count != 1) || (BoostedTo != 1) || (Restored != 3)){
+			printf("FAILED, priority inheritance did not give the priority back\n");
+			return 1;
+		}
+	}else if(strcmp(which, "stacks") == 0){
+		printf("threads %lu of %lu, add failures %lu, stack pool free words before %lu after %lu\n",
+			Count, Spawns, AddFailures, PoolBefore, PoolAfter);
+		if(AddFailures || (PoolBefore != PoolAfter)){
+			printf("FAILED, the stack pool leaked\n");
+			return 1;
+		}
+	}else{
+		printf("bytes %lu, write %.1f ms, read %.1f ms, errors %d\n", FileBytes,
+			WriteTime*1000.0/SIMBUSFREQ, ReadTime*1000.0/SIMBUSFREQ, FileErrors);
+		printf("disk block reads %lu writes %lu\n", SimDiskReads, SimDiskWrites);
+		if(FileErrors){
+			printf("FAILED, the file did not read back\n");
+			return 1;
+		}
+	}
+	return 0;
+}
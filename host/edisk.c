@@ -0,0 +1,124 @@
+// eDisk.c
+// Runs on the PC in the hosted simulation, stands in for the SD card driver
+// The card is a file of 512 byte blocks, SIMDISKFILE unless the SIM_EDISK
+// environment variable names another one. Blocks never written read as 0xFF.
+// Every block transfer charges SIMDISKBLOCKCYCLES of simulated time, so the
+// file system benchmarks see the cost of going to the disk.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "edisk.h"
+#include "sim.h"
+
+#define BLOCKSIZE 512
+
+unsigned long SimDiskReads = 0;
+unsigned long SimDiskWrites = 0;
+static FILE* Disk = NULL;
+
+//*************** eDisk_Init ***********
+// open the disk file, create it if it is not there
+// Inputs: drive number (only drive 0 is supported)
+// Outputs: status
+DSTATUS eDisk_Init(BYTE drive){
+	const char* name;
+	if(drive){
+		return STA_NOINIT;
+	}
+	if(Disk){
+		return 0;
+	}
+	name = getenv("SIM_EDISK");
+	if(name == NULL){
+		name = SIMDISKFILE;
+	}
+	Disk = fopen(name, "r+b");
+	if(Disk == NULL){
+		Disk = fopen(name, "w+b");
+	}
+	return Disk ? 0 : STA_NODISK;
+}
+
+//*************** eDisk_Status ***********
+// Inputs: drive number (only drive 0 is supported)
+// Outputs: status
+DSTATUS eDisk_Status(BYTE drive){
+	if(drive || (Disk == NULL)){
+		return STA_NOINIT;
+	}
+	return 0;
+}
+
+//*************** eDisk_Read ***********
+// Inputs: drive number, RAM buffer, first sector, number of sectors
+// Outputs: result
+DRESULT eDisk_Read(BYTE drv, BYTE *buff, DWORD sector, BYTE count){
+	size_t got;
+	if(drv || !count){
+		return RES_PARERR;
+	}
+	if(Disk == NULL){
+		return RES_NOTRDY;
+	}
+	memset(buff, 0xFF, count*BLOCKSIZE);
+	if(fseek(Disk, (long)sector*BLOCKSIZE, SEEK_SET)){
+		return RES_ERROR;
+	}
+	got = fread(buff, 1, count*BLOCKSIZE, Disk);
+	if(got < count*BLOCKSIZE){
+		memset(buff+got, 0xFF, count*BLOCKSIZE-got);		// past the end of the file
+	}
+	SimDiskReads += count;
+	Sim_Burn(count*SIMDISKBLOCKCYCLES);
+	return RES_OK;
+}
+
+//*************** eDisk_ReadBlock ***********
+// Inputs: RAM buffer, sector number
+// Outputs: result
+DRESULT eDisk_ReadBlock(BYTE *buff, DWORD sector){
+	return eDisk_Read(0, buff, sector, 1);
+}
+
+//*************** eDisk_Write ***********
+// Inputs: drive number, RAM buffer, first sector, number of sectors
+// Outputs: result
+DRESULT eDisk_Write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count){
+	if(drv || !count){
+		return RES_PARERR;
+	}
+	if(Disk == NULL){
+		return RES_NOTRDY;
+	}
+	if(fseek(Disk, (long)sector*BLOCKSIZE, SEEK_SET) ||
+		(fwrite(buff, BLOCKSIZE, count, Disk) != count)){
+		return RES_ERROR;
+	}
+	fflush(Disk);
+	SimDiskWrites += count;
+	Sim_Burn(count*SIMDISKBLOCKCYCLES);
+	return RES_OK;
+}
+
+//*************** eDisk_WriteBlock ***********
+// Inputs: RAM buffer, sector number
+// Outputs: result
+DRESULT eDisk_WriteBlock(const BYTE *buff, DWORD sector){
+	return eDisk_Write(0, buff, sector, 1);
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void* buff){
+	if(drv){
+		return RES_PARERR;
+	}
+	switch(ctrl){
+		case CTRL_SYNC:
+			fflush(Disk);
+			return RES_OK;
+		case GET_SECTOR_SIZE:
+			*(WORD*)buff = BLOCKSIZE;
+			return RES_OK;
+		default:
+			return RES_PARERR;
+	}
+}
@@ -0,0 +1,485 @@
+// sim.c
+// Linux hosted simulation of the LaunchPad for the RTOS kernel
+// Replaces startup.s, osasm.s and PLL.c so OS.c, LinkedList.c, TIMER.c and
+// efile.c run unchanged on a PC, see sim.h for the build line.
+// Time is simulated: it only moves when a thread calls into the kernel
+// (every StartCritical, EndCritical, ... costs SIMHOOKCYCLES), when an
+// interrupt or context switch is taken, when a thread calls Sim_Burn, and
+// when WaitForInterrupt skips ahead to the next interrupt. Runs are therefore
+// repeatable and as fast as the host allows. A thread that spins without
+// calling the kernel never gives the simulator control, so benchmark
+// threads model their work with Sim_Burn.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "OS.h"
+#include "sim.h"
+
+// the real registers behind the accessors in sim.h
+#define RAW_INT_CTRL_R		(*((volatile uint32_t *)0xE000ED04))
+#define RAW_ST_CTRL_R			(*((volatile uint32_t *)0xE000E010))
+#define RAW_ST_CURRENT_R	(*((volatile uint32_t *)0xE000E018))
+#define RAW_TIMER1_TAR_R	(*((volatile uint32_t *)0x40031048))
+#define RAW_WTIMER0_CTL_R	(*((volatile uint32_t *)0x4003600C))
+
+#define SIMHOOKCYCLES 12			// kernel code around each interrupt enable/disable
+#define SIMISRCYCLES 24				// exception entry and return
+#define SIMSWITCHCYCLES 26		// PendSV_Handler body, with EXC_RETURN and the two FP frame tests
+#define SIMACCOUNTCYCLES 20		// Timer1 read, RunTime, LastRun and SwitchCount update, not with -DNOACCOUNTING
+#ifdef NOACCOUNTING
+#define SWITCHACCOUNTCYCLES 0
+#else
+#define SWITCHACCOUNTCYCLES SIMACCOUNTCYCLES
+#endif
+#define SIMFPSAVECYCLES 35		// lazy stacking of S0-S15 and FPSCR, then VPUSH S16-S31
+#define SIMFPRESTORECYCLES 35	// VPOP S16-S31, then unstacking the extended frame on return
+#define SIMATOMICCYCLES 8			// call, LDREX, test, STREX and return of the semaphore fast paths
+#define SIMBURNSLICE 200			// Sim_Burn granularity, bounds interrupt latency
+#define SIMSTACKSIZE 65536		// host stack of each thread, in bytes
+#define SIMMAXIRQ 4
+#define THREADLEVEL 8					// execution priority of thread mode, below all interrupts
+#define SYSTICKPRI 7					// OS_Init puts SysTick and PendSV at priority 7
+#define PENDSVPRI 7
+
+extern tcbType *RunPt;
+extern uint32_t ProxyChange;
+extern tcbType* ProxyThread;
+extern uint32_t HighestPriority;
+void SysTick_Handler(void);
+void PendSV_Handler(void);
+void WideTimer0A_Handler(void);
+
+uint64_t SimTime = 0;
+unsigned long SimSwitches = 0;
+unsigned long SimIrqLost[SIMMAXIRQ];
+static uint64_t SimStopTime = UINT64_MAX;
+static uint32_t Primask = 1;						// interrupts are disabled out of reset
+static uint32_t Basepri = 0;						// as the register holds it, priority<<5, 0 masks nothing
+static uint32_t Level = THREADLEVEL;		// priority of the code that is running
+static uint32_t Vector = 0;							// VECTACTIVE of NVIC_INT_CTRL_R, 0 in thread mode
+static ucontext_t SimMain;							// main() while the OS runs
+static ucontext_t SimContext[SIMTHREADS];
+static void(*SimTask[SIMTHREADS])(void);
+static uint8_t SimFPU[SIMTHREADS];			// the thread has an FP frame, EXC_RETURN bit 4 clear
+static uint8_t SimStack[SIMTHREADS][SIMSTACKSIZE];
+
+static uint32_t StEnabled = 0;
+static uint32_t StPending = 0;
+static uint64_t StNext;						// SimTime at which SysTick counts down to 0
+static uint32_t StShadow = 0;			// CURRENT as last stored, a different value means it was written
+static uint32_t SvPending = 0;
+static uint32_t WtEnabled = 0;		// Wide Timer 0A, only 32-bit one-shot mode on timer A is modeled
+static uint32_t WtPending = 0;
+static uint64_t WtNext;						// SimTime at which it times out
+
+struct simIrq{
+	void(*Handler)(void);
+	uint32_t Period;
+	uint32_t Priority;
+	uint32_t Pending;
+	uint64_t Next;
+};
+static struct simIrq SimIrq[SIMMAXIRQ];
+static int SimNumIrq = 0;
+
+// map the peripheral and private peripheral blocks at their real addresses
+// before main runs, so the register macros can be used right away
+__attribute__((constructor)) static void Sim_MapPeripherals(void){
+	if((mmap((void*)0x40000000, 0x100000, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE, -1, 0) != (void*)0x40000000)||
+		(mmap((void*)0xE000E000, 0x1000, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE, -1, 0) != (void*)0xE000E000)){
+		fprintf(stderr, "sim: can not map the peripheral registers\n");
+		exit(1);
+	}
+}
+
+// SysTick period in bus cycles, from the reload register
+static uint32_t Sim_StPeriod(void){
+	return (NVIC_ST_RELOAD_R&0x00FFFFFF) + 1;
+}
+
+// move simulated time forward and raise the interrupts that came due
+static void Sim_Advance(uint64_t cycles){
+	uint64_t n;
+	int i;
+	SimTime += cycles;
+	if(StEnabled && (SimTime >= StNext)){
+		if(RAW_ST_CTRL_R&NVIC_ST_CTRL_INTEN){
+			StPending = 1;			// several expiries while masked still make one interrupt
+		}
+		n = (SimTime - StNext)/Sim_StPeriod() + 1;
+		StNext += n*Sim_StPeriod();
+	}
+	if(WtEnabled && (SimTime >= WtNext)){
+		WtEnabled = 0;
+		RAW_WTIMER0_CTL_R &= ~TIMER_CTL_TAEN;		// one-shot, it stops itself
+		WTIMER0_RIS_R |= TIMER_RIS_TATORIS;
+		if((WTIMER0_IMR_R&TIMER_IMR_TATOIM) && (NVIC_EN2_R&NVIC_EN2_INT94)){
+			WtPending = 1;
+		}
+	}
+	for(i=0; i<SimNumIrq; i++){
+		if(SimTime >= SimIrq[i].Next){
+			n = (SimTime - SimIrq[i].Next)/SimIrq[i].Period + 1;
+			SimIrqLost[i] += n - 1 + SimIrq[i].Pending;
+			SimIrq[i].Pending = 1;
+			SimIrq[i].Next += n*SimIrq[i].Period;
+		}
+	}
+}
+
+// apply whatever the program wrote to the side effect registers since the last call,
+// then store their current values so reads see the right thing
+static void Sim_Latch(void){
+	uint32_t ctrl = RAW_ST_CTRL_R;
+	uint32_t intCtrl = RAW_INT_CTRL_R;
+	if((ctrl&NVIC_ST_CTRL_ENABLE) && !StEnabled){
+		StNext = SimTime + Sim_StPeriod();		// OS always clears CURRENT before enabling
+	}
+	StEnabled = ctrl&NVIC_ST_CTRL_ENABLE;
+	if(RAW_ST_CURRENT_R != StShadow){				// any write clears it, it reloads on the next cycle
+		StNext = SimTime + 1 + Sim_StPeriod();
+	}
+	if(intCtrl&NVIC_INT_CTRL_PEND_SV){
+		SvPending = 1;
+	}
+	if(intCtrl&NVIC_INT_CTRL_UNPEND_SV){
+		SvPending = 0;
+	}
+	if(intCtrl&NVIC_INT_CTRL_PENDSTSET){
+		StPending = 1;
+	}
+	if(intCtrl&NVIC_INT_CTRL_PENDSTCLR){
+		StPending = 0;
+	}
+	// writing the count it already had (1 chance in the period) is missed, that is harmless
+	if(StEnabled){
+		StShadow = StNext - SimTime - 1;
+	}else{
+		StShadow = RAW_ST_CURRENT_R;
+	}
+	RAW_ST_CURRENT_R = StShadow;
+	if((RAW_WTIMER0_CTL_R&TIMER_CTL_TAEN) && !WtEnabled){		// enabling loads TAILR
+		WtNext = SimTime + WTIMER0_TAILR_R + 1;
+	}
+	WtEnabled = RAW_WTIMER0_CTL_R&TIMER_CTL_TAEN;
+	RAW_INT_CTRL_R = (SvPending ? NVIC_INT_CTRL_PEND_SV : 0)|(StPending ? NVIC_INT_CTRL_PENDSTSET : 0)|Vector;
+	if(TIMER1_CTL_R&TIMER_CTL_TAEN){		// Timer1 free runs down from TAILR
+		RAW_TIMER1_TAR_R = TIMER1_TAILR_R - (uint32_t)(SimTime%((uint64_t)TIMER1_TAILR_R+1));
+	}
+}
+
+volatile uint32_t* Sim_IntCtrl(void){
+	Sim_Latch();
+	return &RAW_INT_CTRL_R;
+}
+volatile uint32_t* Sim_StCtrl(void){
+	Sim_Latch();
+	return &RAW_ST_CTRL_R;
+}
+volatile uint32_t* Sim_StCurrent(void){
+	Sim_Latch();
+	return &RAW_ST_CURRENT_R;
+}
+volatile uint32_t* Sim_Timer1Tar(void){
+	Sim_Latch();
+	return &RAW_TIMER1_TAR_R;
+}
+volatile uint32_t* Sim_WTimer0Ctl(void){
+	Sim_Latch();
+	return &RAW_WTIMER0_CTL_R;
+}
+
+// NVIC priority of Wide Timer 0A, interrupt 94
+static uint32_t Sim_WtPriority(void){
+	return (NVIC_PRI23_R&NVIC_PRI23_INTC_M)>>NVIC_PRI23_INTC_S;
+}
+
+// take every pending interrupt that can preempt the running code,
+// highest priority first, PendSV before SysTick on a tie like the NVIC
+static void Sim_Poll(void){
+	uint32_t pri, saved, savedVector;
+	int i, source;
+	Sim_Latch();
+	while(Primask == 0){
+		source = -3;
+		pri = Level;
+		if(Basepri && ((Basepri>>5) < pri)){
+			pri = Basepri>>5;		// only the zero-latency band gets in
+		}
+		if(SvPending && (PENDSVPRI < pri)){
+			source = -1;
+			pri = PENDSVPRI;
+		}
+		if(StPending && (SYSTICKPRI < pri)){
+			source = -2;
+			pri = SYSTICKPRI;
+		}
+		if(WtPending && (Sim_WtPriority() < pri)){
+			source = -4;
+			pri = Sim_WtPriority();
+		}
+		for(i=0; i<SimNumIrq; i++){
+			if(SimIrq[i].Pending && (SimIrq[i].Priority < pri)){
+				source = i;
+				pri = SimIrq[i].Priority;
+			}
+		}
+		if(source == -3){
+			break;
+		}
+		saved = Level;
+		savedVector = Vector;
+		Level = pri;
+		Sim_Advance(SIMISRCYCLES);
+		if(source == -1){
+			Vector = 14;
+			SvPending = 0;
+			RAW_INT_CTRL_R &= ~NVIC_INT_CTRL_PEND_SV;
+			PendSV_Handler();
+		}else if(source == -2){
+			Vector = 15;
+			StPending = 0;
+			RAW_INT_CTRL_R &= ~NVIC_INT_CTRL_PENDSTSET;
+			SysTick_Handler();
+		}else if(source == -4){
+			Vector = 110;		// interrupt 94
+			WtPending = 0;
+			WideTimer0A_Handler();
+		}else{
+			Vector = SIMIRQVECTOR + source;
+			SimIrq[source].Pending = 0;
+			SimIrq[source].Handler();
+		}
+		Level = saved;
+		Vector = savedVector;
+		Sim_Latch();
+	}
+	if((SimTime >= SimStopTime) && (Primask == 0) && (Basepri == 0) && (Level == THREADLEVEL)){
+		SimStopTime = UINT64_MAX;
+		setcontext(&SimMain);		// StartOS returns to OS_Launch
+	}
+}
+
+// every host thread starts here
+static void Sim_ThreadStart(int id){
+	Primask = 0;
+	Basepri = 0;
+	Level = THREADLEVEL;
+	Vector = 0;
+	SimTask[id]();
+	OS_Kill();				// on the board returning from a thread faults
+}
+
+void Sim_ThreadInit(struct tcb* thread, void(*task)(void)){
+	int id = thread->ID;
+	if(id >= SIMTHREADS){
+		fprintf(stderr, "sim: thread ID %d has no host context\n", id);
+		exit(1);
+	}
+	SimTask[id] = task;
+	SimFPU[id] = 0;		// the initial stack has a basic frame
+	getcontext(&SimContext[id]);
+	SimContext[id].uc_stack.ss_sp = SimStack[id];
+	SimContext[id].uc_stack.ss_size = SIMSTACKSIZE;
+	SimContext[id].uc_link = NULL;
+	makecontext(&SimContext[id], (void(*)(void))Sim_ThreadStart, 1, id);
+	thread->sp = (int32_t*)&SimContext[id];
+}
+
+void Sim_UseFPU(void){
+	SimFPU[RunPt->ID] = 1;
+}
+
+void Sim_Burn(uint32_t cycles){
+	uint32_t slice;
+	while(cycles){
+		slice = (cycles > SIMBURNSLICE) ? SIMBURNSLICE : cycles;
+		Sim_Advance(slice);
+		Sim_Poll();
+		cycles -= slice;
+	}
+}
+
+int Sim_AddInterrupt(void(*handler)(void), uint32_t period, uint32_t priority){
+	if((SimNumIrq >= SIMMAXIRQ) || (period == 0)){
+		return 0;
+	}
+	SimIrq[SimNumIrq].Handler = handler;
+	SimIrq[SimNumIrq].Period = period;
+	SimIrq[SimNumIrq].Priority = priority;
+	SimIrq[SimNumIrq].Pending = 0;
+	SimIrq[SimNumIrq].Next = SimTime + period;
+	SimNumIrq++;
+	return 1;
+}
+
+void Sim_StopAfter(uint64_t cycles){
+	SimStopTime = SimTime + cycles;
+}
+
+//************ functions from startup.s ************
+void DisableInterrupts(void){
+	Sim_Advance(SIMHOOKCYCLES);
+	Sim_Poll();
+	Primask = 1;
+}
+
+void EnableInterrupts(void){
+	Primask = 0;
+	Sim_Advance(SIMHOOKCYCLES);
+	Sim_Poll();
+}
+
+// skip ahead to the next interrupt or to the end of the simulation
+void WaitForInterrupt(void){
+	uint64_t next = SimStopTime;
+	int i;
+	Sim_Latch();
+	if(StEnabled && (RAW_ST_CTRL_R&NVIC_ST_CTRL_INTEN) && (StNext < next)){
+		next = StNext;
+	}
+	for(i=0; i<SimNumIrq; i++){
+		if(SimIrq[i].Next < next){
+			next = SimIrq[i].Next;
+		}
+	}
+	if(WtEnabled && (WtNext < next)){
+		next = WtNext;
+	}
+	if(StPending || SvPending || WtPending){
+		next = SimTime;
+	}
+	for(i=0; i<SimNumIrq; i++){
+		if(SimIrq[i].Pending){
+			next = SimTime;
+		}
+	}
+	if(next == UINT64_MAX){
+		fprintf(stderr, "sim: WaitForInterrupt with no interrupt that could wake it\n");
+		exit(1);
+	}
+	if(next > SimTime){
+		Sim_Advance(next - SimTime);
+	}
+	Sim_Poll();
+}
+
+//************ functions from osasm.s ************
+// weak like in osasm.s, the PROFILER build of OS.c supplies its own
+__attribute__((weak)) int32_t StartCritical(void){
+	int32_t old;
+	Sim_Advance(SIMHOOKCYCLES);
+	Sim_Poll();
+	old = Basepri;
+	if((Basepri == 0) || (Basepri > (OS_KERNELPRI<<5))){		// BASEPRI_MAX only raises the mask
+		Basepri = OS_KERNELPRI<<5;
+	}
+	return old;
+}
+
+__attribute__((weak)) void EndCritical(int32_t basepri){
+	Basepri = basepri;
+	Sim_Advance(SIMHOOKCYCLES);
+	Sim_Poll();
+}
+
+void OS_DisableInterrupts(void){
+	DisableInterrupts();
+}
+
+void OS_EnableInterrupts(void){
+	EnableInterrupts();
+}
+
+uint32_t HighestPri(void){
+	return HighestPriority ? __builtin_clz(HighestPriority) : 32;		// CLZ of 0 is 32 on the M4
+}
+
+// an interrupt can only come in before the update, as the real STREX
+// would fail and retry if one came in between
+int Sema4TryDecrement(long* value){
+	long old;
+	Sim_Advance(SIMATOMICCYCLES);
+	Sim_Poll();
+	old = __atomic_load_n(value, __ATOMIC_RELAXED);
+	do{
+		if(old <= 0){
+			return 0;
+		}
+	}while(!__atomic_compare_exchange_n(value, &old, old-1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	return 1;
+}
+
+int Sema4TryIncrement(long* value){
+	long old;
+	Sim_Advance(SIMATOMICCYCLES);
+	Sim_Poll();
+	old = __atomic_load_n(value, __ATOMIC_RELAXED);
+	do{
+		if(old < 0){
+			return 0;
+		}
+	}while(!__atomic_compare_exchange_n(value, &old, old+1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return 1;
+}
+
+// same steps as the assembly version, the ucontext stands in for the saved registers
+void PendSV_Handler(void){
+	tcbType* old = RunPt;
+	tcbType* new;
+#ifndef NOACCOUNTING
+	uint32_t now;
+#endif
+	Basepri = OS_KERNELPRI<<5;
+#ifndef NOACCOUNTING
+	now = TIMER1_TAR_R;
+	old->RunTime += old->LastRun - now;
+#endif
+	if(ProxyChange){
+		new = ProxyThread;
+		ProxyChange = 0;
+	}else{
+		new = old->next;
+	}
+	RunPt = new;
+#ifndef NOACCOUNTING
+	new->LastRun = now;
+	new->SwitchCount++;
+#endif
+	Sim_Advance(SIMSWITCHCYCLES + SWITCHACCOUNTCYCLES + (SimFPU[old->ID] ? SIMFPSAVECYCLES : 0) +
+		(SimFPU[new->ID] ? SIMFPRESTORECYCLES : 0));
+	if(new != old){
+		SimSwitches++;
+		swapcontext((ucontext_t*)old->sp, (ucontext_t*)new->sp);
+	}
+	Basepri = 0;
+}
+
+// runs RunPt, returns when the Sim_StopAfter time is reached
+void StartOS(void){
+	Level = THREADLEVEL;
+	Primask = 0;
+	swapcontext(&SimMain, (ucontext_t*)RunPt->sp);
+	Primask = 1;
+}
+
+//************ functions from cpu.c ************
+unsigned long CPUbasepriGet(void){
+	return Basepri;
+}
+
+void CPUbasepriSet(unsigned long newBasepri){
+	Sim_Advance(SIMHOOKCYCLES);
+	Sim_Poll();
+	Basepri = newBasepri;
+	Sim_Poll();
+}
+
+//************ functions from PLL.c ************
+void PLL_Init(void){
+}
@@ -0,0 +1,93 @@
+// sim.h
+// Linux hosted simulation of the LaunchPad for the RTOS kernel
+// Threads run on ucontexts, PendSV_Handler/StartOS/StartCritical and friends
+// are C functions in sim.c, SysTick, Timer1 and the one-shot Wide Timer 0A
+// count simulated bus cycles.
+// Included by OS.c after tm4c123gh6pm.h when HOSTSIM is defined.
+// Build (from the repository root):
+//   gcc -O2 -DHOSTSIM -I. -Ihost -o rtosbench host/bench.c host/sim.c host/edisk.c OS.c LinkedList.c TIMER.c efile.c
+// add -DNOACCOUNTING to drop the RunTime/LastRun/SwitchCount update from PendSV_Handler
+#ifndef SIM_H
+#define SIM_H
+#include <stdint.h>
+
+#define SIMBUSFREQ 80000000		// simulated bus cycles per second
+#define SIMTHREADS 32					// ucontexts, one per TCB, must cover NUMTHREADS in OS.c
+
+// The peripheral blocks at 0x40000000 and 0xE000E000 are mapped as plain RAM
+// by sim.c, so every register macro in tm4c123gh6pm.h works unchanged.
+// The few registers whose value depends on time or whose writes have side
+// effects go through accessors instead, each call also latches the previous write.
+volatile uint32_t* Sim_IntCtrl(void);
+volatile uint32_t* Sim_StCtrl(void);
+volatile uint32_t* Sim_StCurrent(void);
+volatile uint32_t* Sim_Timer1Tar(void);
+volatile uint32_t* Sim_WTimer0Ctl(void);
+#undef NVIC_INT_CTRL_R
+#define NVIC_INT_CTRL_R (*Sim_IntCtrl())
+#undef NVIC_ST_CTRL_R
+#define NVIC_ST_CTRL_R (*Sim_StCtrl())
+#undef NVIC_ST_CURRENT_R
+#define NVIC_ST_CURRENT_R (*Sim_StCurrent())
+#undef TIMER1_TAR_R
+#define TIMER1_TAR_R (*Sim_Timer1Tar())
+#undef WTIMER0_CTL_R
+#define WTIMER0_CTL_R (*Sim_WTimer0Ctl())		// one-shot timer A behind the software timers
+
+// simulated bus cycles since the simulation started
+extern uint64_t SimTime;
+// context switches PendSV_Handler has made
+extern unsigned long SimSwitches;
+
+// ******** Sim_ThreadInit ************
+// give a TCB a fresh host context that starts at task
+// called by OS_AddThread, the TCB's sp field points at the ucontext
+// Inputs:  TCB (its ID selects the context), thread function
+// Outputs: none
+struct tcb;
+void Sim_ThreadInit(struct tcb* thread, void(*task)(void));
+
+// ******** Sim_Burn ************
+// model a piece of work that takes a number of bus cycles
+// the time is charged in slices so interrupts still preempt it
+// Inputs:  bus cycles
+// Outputs: none
+void Sim_Burn(uint32_t cycles);
+
+// ******** Sim_UseFPU ************
+// model the running thread executing a floating point instruction,
+// from then on each of its context switches saves and restores the FPU
+// registers, like CONTROL.FPCA and EXC_RETURN on the board
+// Inputs:  none
+// Outputs: none
+void Sim_UseFPU(void);
+
+// ******** Sim_AddInterrupt ************
+// add a periodic interrupt source, like an ADC or timer interrupt
+// Inputs:  handler, period in bus cycles, NVIC priority 0 to 7 (0 highest)
+// Outputs: 1 if added, 0 if the table is full
+int Sim_AddInterrupt(void(*handler)(void), uint32_t period, uint32_t priority);
+
+// while a Sim_AddInterrupt handler runs, VECTACTIVE in NVIC_INT_CTRL_R reads
+// SIMIRQVECTOR plus its index, as if the sources were interrupts 0 to 3
+#define SIMIRQVECTOR 16
+
+// ******** Sim_StopAfter ************
+// end the simulation once this much simulated time has passed
+// OS_Launch then returns to its caller so results can be printed
+// Inputs:  bus cycles from now
+// Outputs: none
+void Sim_StopAfter(uint64_t cycles);
+
+// number of interrupts of each source that were lost because the
+// previous one was still pending, index is the Sim_AddInterrupt order
+extern unsigned long SimIrqLost[];
+
+// host edisk.c keeps the disk in a file, SIMDISKFILE or the SIM_EDISK
+// environment variable, and charges each block transfer as bus cycles
+#define SIMDISKFILE "edisk.img"
+#define SIMDISKBLOCKCYCLES 48000		// 512 bytes over 8 MHz SSI plus command overhead
+extern unsigned long SimDiskReads;
+extern unsigned long SimDiskWrites;
+
+#endif
@@ -0,0 +1,89 @@
+// trace2json.c
+// Runs on the PC, converts the kernel trace printed by OS_TraceDump
+// (PROFILE command in the interpreter) into Chrome trace event JSON
+// Open the output in chrome://tracing or ui.perfetto.dev
+// Build: gcc -O2 -o trace2json trace2json.c
+// Usage: trace2json < capture.txt > trace.json
+// Lines before "TRACE n" and after "END" are ignored, so a raw
+// terminal log can be fed in directly
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BUSFREQ 80				// bus cycles per microsecond, 80 MHz
+#define NOTHREAD 0xFF
+
+static const char* EventName[] = {
+	"suspend", "kill", "sleep", "wake", "switch", "block", "unblock", "isr"
+};
+#define NUMEVENTS (sizeof(EventName)/sizeof(EventName[0]))
+#define THREADSWITCH 4
+#define ISRENTRY 7
+
+static int First = 1;
+
+static void Comma(void){
+	if(!First){
+		printf(",\n");
+	}
+	First = 0;
+}
+
+int main(void){
+	char line[128];
+	int inTrace = 0;
+	unsigned long long time = 0;		// bus cycles since the first record
+	unsigned int running = NOTHREAD;	// thread with an open slice
+	unsigned int delta, event, id, object;
+	double ts;
+
+	printf("{\"traceEvents\":[\n");
+	while(fgets(line, sizeof(line), stdin)){
+		if(!inTrace){
+			if(strncmp(line, "TRACE", 5) == 0){
+				inTrace = 1;
+				time = 0;
+			}
+			continue;
+		}
+		if(strncmp(line, "END", 3) == 0){
+			inTrace = 0;
+			continue;
+		}
+		if(sscanf(line, "%8x%2x%2x%4x", &delta, &event, &id, &object) != 4){
+			continue;		// garbled line, skip it
+		}
+		time += delta;
+		ts = (double)time/BUSFREQ;
+		if(event == THREADSWITCH){
+			if(running != NOTHREAD){
+				Comma();
+				printf("{\"name\":\"thread %u\",\"ph\":\"E\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					running, running, ts);
+			}
+			running = id;
+			if(running != NOTHREAD){
+				Comma();
+				printf("{\"name\":\"thread %u\",\"ph\":\"B\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+					running, running, ts);
+			}
+			continue;
+		}
+		Comma();
+		if(event == ISRENTRY){
+			printf("{\"name\":\"isr %u\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+				object, ts);
+		}else{
+			printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"object\":\"0x%04x\"}}",
+				(event < NUMEVENTS) ? EventName[event] : "unknown",
+				(id == NOTHREAD) ? 0 : id, ts, object);
+		}
+	}
+	if(running != NOTHREAD){
+		Comma();
+		printf("{\"name\":\"thread %u\",\"ph\":\"E\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+			running, running, (double)time/BUSFREQ);
+	}
+	printf("\n]}\n");
+	return 0;
+}
@@ -32,16 +32,16 @@
 		EXTERN  HighestPriority  ;holds the bit mapping for each priority
 		EXTERN  ProxyThread
 		EXTERN  ProxyChange
-		EXTERN 	ThreadStart
-		EXTERN 	ThreadEnd
-		EXTERN	ThreadArray
-		EXTERN  ThreadCount
 		EXTERN  Timer1_TAILR_Ptr
         EXPORT  OS_DisableInterrupts
         EXPORT  OS_EnableInterrupts
         EXPORT  StartOS
         EXPORT  PendSV_Handler
 		EXPORT  HighestPri
+		EXPORT  Sema4TryDecrement
+		EXPORT  Sema4TryIncrement
+		EXPORT  StartCritical [WEAK]		; OS.c has timed ones when PROFILER is defined
+		EXPORT  EndCritical [WEAK]
 		;EXPORT  SysTick_Handler
 
 
@@ -54,81 +54,90 @@ OS_EnableInterrupts
         CPSIE   I
         BX      LR
 
+KERNELBASEPRI	EQU	0x20		; OS_KERNELPRI in OS.h, in the top 3 bits like BASEPRI holds it
+
+;*********** StartCritical ************************
+; make a copy of previous BASEPRI, mask the interrupts at OS_KERNELPRI and below,
+; the zero-latency band above it keeps running
+; inputs:  none
+; outputs: previous BASEPRI
+StartCritical
+        MRS    R0, BASEPRI      ; save old status
+        MOV    R1, #KERNELBASEPRI
+        MSR    BASEPRI_MAX, R1  ; only ever raises the mask, so it nests
+        BX     LR
+
+;*********** EndCritical ************************
+; using the copy of previous BASEPRI, restore it
+; inputs:  previous BASEPRI
+; outputs: none
+EndCritical
+        MSR    BASEPRI, R0
+        BX     LR
+
+;TCB offsets used for CPU time accounting, same as TCB_RUNTIME... in OS.h
+TCB_RUNTIME		EQU	56			; 64-bit RunTime
+TCB_LASTRUN		EQU	64			; LastRun
+TCB_SWITCHES	EQU	68			; SwitchCount
+TIMER1_TAR		EQU	0x40031048	; free running Timer1, counts down
+
 ; Does a context switch on demand
+; Charges the time since the old thread was switched in to its RunTime,
+; and stamps the new thread with the switch time and one more SwitchCount,
+; unless NOACCOUNTING is defined (Asm Define), which testmain7 uses as the baseline
+; EXC_RETURN is saved with each thread. Bit 4 clear means the thread has used
+; the FPU and the hardware stacked an extended frame, with room for S0-S15 and
+; FPSCR filled in lazily, so only those threads also save and restore S16-S31
 PendSV_Handler
-	CPSID   I                  ; 2) Prevent interrupt during switch
-    PUSH    {R4-R11}           ; 3) Save remaining regs r4-11
+	MOV		R0, #KERNELBASEPRI
+	MSR		BASEPRI, R0			; 2) Prevent kernel interrupts during switch, PendSV only runs at BASEPRI 0
+	TST		LR, #0x10			; EXC_RETURN bit 4 clear, the thread has an FP frame
+	IT		EQ
+	VPUSHEQ	{S16-S31}			; also makes the lazy S0-S15 save happen
+    PUSH    {R4-R11,LR}        ; 3) Save remaining regs r4-11 and EXC_RETURN
     LDR     R0, =RunPt         ; 4) R0=pointer to RunPt, old thread
     LDR     R1, [R0]           ;    R1 = RunPt
     STR     SP, [R1]           ; 5) Save SP into TCB
 	
+	IF :LNOT::DEF:NOACCOUNTING
+	LDR		R3, =TIMER1_TAR
+	LDR		R3, [R3]			; R3 = now
+	LDR		R5, [R1,#TCB_LASTRUN]	; R5 = RunPt->LastRun
+	SUB		R5, R5, R3			; time RunPt ran, Timer1 counts down
+	LDRD	R4, R6, [R1,#TCB_RUNTIME]	; R6:R4 = RunPt->RunTime
+	ADDS	R4, R4, R5
+	ADC		R6, R6, #0
+	STRD	R4, R6, [R1,#TCB_RUNTIME]
+	ENDIF
+	
 	LDR   	R2, =ProxyChange
-	LDR		R3, [R2]			;R3 has ProxyChange
-	CMP		R3, #0
+	LDR		R6, [R2]			;R6 has ProxyChange
+	CMP		R6, #0
 	BNE		JumpToHigher
 	LDR 	R1, [R1,#4]			   ; R1 = RunPt, [R1,#4] = RunPt->next
 	STR     R1, [R0]           ;    RunPt = R1 (RunPt = RunPt->next)
-	LDR     SP, [R1]           ; 7) new thread SP; SP = RunPt->sp;
-
-; profile information
-;	LDR		R7, =ThreadArray
-;	LDR		R8, =ThreadCount ; index of where we are in the array
-;	LDR		R9, [R8]	; R9 = ThreadCount
-;	CMP		R9, #400	; check if ThreadCount == 100*4bytes
-;	BEQ		Done		; If i have already captured 100 events, then don't profile
-;	
-;	ADD		R10, R7, R9 ; R10 = R7 + R9 = &ThreadArray + ThreadCount
-;	STR		R1,[R10]		;ThreadArray[ThreadCount] = RunPt , this is the new RunPt
-;	
-;	LDR		R11, =ThreadStart ; R11 = &ThreadStart
-;	ADD		R10, R11, R9 ; R10 = R11+R9 = &ThreadStart + ThreadCount
-;	LDR		R4, =Timer1_TAILR_Ptr
-;	LDR		R4, [R4] ; R4 = &TIMER1_TAILR_R
-;	LDR		R4, [R4] ; R4 = TIMER1_TAILR_R
-;	STR		R4, [R10]	; ThreadStart = TIMER1_TAILR_R
-	
-;	LDR		R9, [R8]; tempVar = ThreadCount
-;	ADD		R9,#4  ; tempVar++ == tempVar + 4 bytes
-;	STR		R9,[R8]; ThreadCount = tempVar
-; profile information	
-	
 	B		Done
 JumpToHigher	
-	LDR		R4, =ProxyThread	;R2 = pointer to HigherRunPt
-	LDR		R5, [R4]			;R3 = HigherRunPt
-	STR 	R5, [R0]			; RunPt = HigherRunPt
-		
-; profile information
-;	LDR		R7, =ThreadArray
-;	LDR		R8, =ThreadCount ; index of where we are in the array
-;	LDR		R9, [R8]	; R9 = ThreadCount
-;	CMP		R9, #400	; check if ThreadCount == 100*4bytes
-;	BEQ		HigherRunPtDone		; If i have already captured 100 events, don't profile
-;	
-;	ADD		R10, R7, R9 ; R10 = R7 + R9 = &ThreadArray + ThreadCount
-;	STR		R5,[R10]	; ThreadArray[ThreadCount] = RunPt , R5 holds HigherRunPt
-;	
-;	LDR		R11, =ThreadStart 	; R11 = &ThreadStart
-;	ADD		R10, R11, R9 		; R10 = R11+R9 = &ThreadStart + ThreadCount
-;	LDR		R4, =Timer1_TAILR_Ptr
-;	LDR		R4, [R4] 			; R4 = &TIMER1_TAILR_R
-;	LDR		R4, [R4] 			; R4 = TIMER1_TAILR_R
-;	STR		R4, [R10]			; ThreadStart = TIMER1_TAILR_R
-;	
-;	LDR		R9, [R8]			; tempVar = ThreadCount
-;	ADD		R9,#4  				; tempVar++ == tempVar + 4 bytes
-;	STR		R9,[R8]				; Result: ThreadCount = ThreadCount++
-;	
-; profile information
-
-HigherRunPtDone	
+	LDR		R4, =ProxyThread	;R4 = pointer to HigherRunPt
+	LDR		R1, [R4]			;R1 = HigherRunPt
+	STR 	R1, [R0]			; RunPt = HigherRunPt
 	MOV 	R6, #0
 	STR		R6, [R2]			;Clear PriorityChange flag
-	LDR 	SP, [R5]			; SP = HigherRunPt->sp
 Done
-    POP     {R4-R11}           ; 8) restore regs r4-11
-    CPSIE   I                  ; 9) tasks run with interrupts enabled
-    BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
+	IF :LNOT::DEF:NOACCOUNTING
+	STR		R3, [R1,#TCB_LASTRUN]	; RunPt->LastRun = now
+	LDR		R4, [R1,#TCB_SWITCHES]
+	ADD		R4, R4, #1
+	STR		R4, [R1,#TCB_SWITCHES]	; RunPt->SwitchCount++
+	ENDIF
+    LDR     SP, [R1]           ; 7) new thread SP; SP = RunPt->sp;
+    POP     {R4-R11,LR}        ; 8) restore regs r4-11 and EXC_RETURN
+	TST		LR, #0x10
+	IT		EQ
+	VPOPEQ	{S16-S31}			; only for a thread that has an FP frame
+	MOV		R0, #0
+	MSR		BASEPRI, R0			; 9) tasks run with interrupts enabled
+    BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR (and S0-S15,FPSCR)
 
 
 
@@ -138,6 +147,7 @@ StartOS
     LDR     R2, [R0]           ; R2 = value of RunPt
     LDR     SP, [R2]           ; new thread SP; SP = RunPt->stackPointer;
     POP     {R4-R11}           ; restore regs r4-11
+    ADD     SP, SP, #4         ; discard EXC_RETURN, the first thread has no FP frame
     POP     {R0-R3}            ; restore regs r0-3
     POP     {R12}
     POP     {LR}               ; discard LR from initial stack
@@ -175,6 +185,42 @@ HighestPri
 ;    CPSIE   I                  ; 9) tasks run with interrupts enabled
 ;    BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
 
+; Uncontended semaphore fast paths, used by OS_Wait and OS_Signal in OS.c
+; An exception between LDREX and STREX clears the exclusive monitor, so the
+; STREX fails and the update is retried if an ISR touched the counter.
+; Anything else falls back to the blocking path in OS.c.
+
+; take one count if the semaphore is free, never blocks
+; Input: R0 points to the counter
+; Output: R0 = 1 if it was decremented, 0 if it was <= 0 and is unchanged
+Sema4TryDecrement
+	LDREX	R1, [R0]		; counter
+	SUBS	R1, R1, #1		; counter - 1
+	BMI		Sema4Busy		; would block, leave it to the kernel
+	STREX	R2, R1, [R0]	; try update
+	CMP		R2, #0			; succeed?
+	BNE		Sema4TryDecrement	; no, try again
+	MOVS	R0, #1
+	BX		LR
+Sema4Busy
+	CLREX
+	MOVS	R0, #0
+	BX		LR
+
+; give one count back if no thread is blocked on the semaphore
+; Input: R0 points to the counter
+; Output: R0 = 1 if it was incremented, 0 if it was < 0 (a thread to wake) and is unchanged
+Sema4TryIncrement
+	LDREX	R1, [R0]		; counter
+	CMP		R1, #0
+	BLT		Sema4Busy		; a waiter has to be woken by the kernel
+	ADDS	R1, R1, #1		; counter + 1
+	STREX	R2, R1, [R0]	; try update
+	CMP		R2, #0			; succeed?
+	BNE		Sema4TryIncrement	; no, try again
+	MOVS	R0, #1
+	BX		LR
+
 ; Spin-Lock counting Semaphore
 ;OS_Wait ;R0 points to counter
 ;	LDREX	R1,[R0] ; counter
@@ -252,21 +252,28 @@ __Vectors
         EXPORT  Reset_Handler
 Reset_Handler
         ;
-        ; DO NOT enable the floating-point unit.  This must be done here to handle the
+        ; Enable the floating-point unit.  This must be done here to handle the
         ; case where main() uses floating-point and the function prologue saves
         ; floating-point registers (which will fault if floating-point is not
-        ; enabled).  Any configuration of the floating-point unit using
-        ; DriverLib APIs must be done here prior to the floating-point unit
-        ; being enabled.
+        ; enabled).  PendSV_Handler in osasm.s saves S16-S31 for the threads
+        ; that use it, so automatic state preservation (ASPEN) and lazy
+        ; stacking of S0-S15 (LSPEN) are both turned on in FPCCR.
         ;
         ; Note that this does not use DriverLib since it might not be included
         ; in this project.
         ;
-;        MOVW    R0, #0xED88
-;        MOVT    R0, #0xE000
-;        LDR     R1, [R0]
-;        ORR     R1, #0x00F00000
-;        STR     R1, [R0]
+        MOVW    R0, #0xED88         ; CPACR
+        MOVT    R0, #0xE000
+        LDR     R1, [R0]
+        ORR     R1, #0x00F00000     ; full access to CP10 and CP11
+        STR     R1, [R0]
+        MOVW    R0, #0xEF34         ; FPCCR
+        MOVT    R0, #0xE000
+        LDR     R1, [R0]
+        ORR     R1, #0xC0000000     ; ASPEN and LSPEN
+        STR     R1, [R0]
+        DSB
+        ISB
 
         ;
         ; Call the C library enty point that handles startup.  This will copy
@@ -591,8 +598,6 @@ PWM1Fault_Handler
 ;******************************************************************************
         EXPORT  DisableInterrupts
         EXPORT  EnableInterrupts
-        EXPORT  StartCritical
-        EXPORT  EndCritical
         EXPORT  WaitForInterrupt
 
 ;*********** DisableInterrupts ***************
@@ -611,23 +616,6 @@ EnableInterrupts
         CPSIE  I
         BX     LR
 
-;*********** StartCritical ************************
-; make a copy of previous I bit, disable interrupts
-; inputs:  none
-; outputs: previous I bit
-StartCritical
-        MRS    R0, PRIMASK  ; save old status
-        CPSID  I            ; mask all (except faults)
-        BX     LR
-
-;*********** EndCritical ************************
-; using the copy of previous I bit, restore I bit to previous value
-; inputs:  previous I bit
-; outputs: none
-EndCritical
-        MSR    PRIMASK, R0
-        BX     LR
-
 ;*********** WaitForInterrupt ************************
 ; go to low power mode while waiting for the next interrupt
 ; inputs:  none